@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sim_trace.h"
+
+/*
+ * Offline analyzer for simulator traces.
+ *
+ * usage: sim_analyze [-w window] trace [trace2]
+ *
+ * The trace is memory-mapped and analyzed in a single pass. Both the text
+ * log printed by the sim_sched_* programs and the binary trace written by
+ * sim_sched_advanced -b are accepted; the binary one is recognized by its
+ * magic. With two traces, per-process deltas (trace2 - trace) are printed.
+ */
+
+#define SIM_ANALYZE_WINDOW 1000
+
+struct sim_analyze_proc {
+	bool seen;
+	enum sim_trace_pstate state;
+	long long since;
+	long long created;
+	long long first_run;
+	long long exited;
+	long long ready_time;
+	long long run_time;
+	long long blocked_time;
+	long long lock_time;
+	int dispatches;
+};
+
+struct sim_analyze_run {
+	const char *path;
+	struct sim_analyze_proc *procs;
+	int nprocs;
+	long long clock;
+	int nr_ready;
+	int nr_running;
+	int ncpus;
+	/* time-weighted ready queue length histogram */
+	long long *qlen_time;
+	long long qlen_cap;
+	int qlen_max;
+	/* CPU busy time per window */
+	long long *busy;
+	long long nwindows;
+	long long window;
+	long long events;
+};
+
+static void *_sim_analyze_grow(void *p, size_t elem, long long *cap, long long need)
+{
+	long long ncap = *cap ? *cap : 16;
+
+	if (need < *cap)
+		return p;
+	while (ncap <= need)
+		ncap *= 2;
+	p = realloc(p, ncap * elem);
+	if (p == NULL) {
+		perror("realloc");
+		exit(1);
+	}
+	memset((char *)p + *cap * elem, 0, (ncap - *cap) * elem);
+	*cap = ncap;
+
+	return p;
+}
+
+static struct sim_analyze_proc *_sim_analyze_getproc(struct sim_analyze_run *r, int pid)
+{
+	long long cap = r->nprocs;
+
+	if (pid < 0)
+		return NULL;
+	r->procs = _sim_analyze_grow(r->procs, sizeof(*r->procs), &cap, pid);
+	r->nprocs = cap;
+
+	return &r->procs[pid];
+}
+
+/* Account [r->clock, clock) before applying an event at clock */
+static void _sim_analyze_advance(struct sim_analyze_run *r, long long clock)
+{
+	long long t, end;
+
+	if (clock <= r->clock)
+		return;
+
+	r->qlen_time = _sim_analyze_grow(r->qlen_time, sizeof(*r->qlen_time), &r->qlen_cap, r->nr_ready);
+	r->qlen_time[r->nr_ready] += clock - r->clock;
+	if (r->nr_ready > r->qlen_max)
+		r->qlen_max = r->nr_ready;
+
+	if (r->nr_running > 0) {
+		r->busy = _sim_analyze_grow(r->busy, sizeof(*r->busy), &r->nwindows, (clock - 1) / r->window);
+		for (t = r->clock; t < clock; t = end) {
+			end = (t / r->window + 1) * r->window;
+			if (end > clock)
+				end = clock;
+			r->busy[t / r->window] += (end - t) * r->nr_running;
+		}
+	}
+	r->clock = clock;
+}
+
+static void _sim_analyze_state(struct sim_analyze_run *r, long long clock, int pid, int cpu, enum sim_trace_pstate to)
+{
+	struct sim_analyze_proc *p = _sim_analyze_getproc(r, pid);
+	long long spent;
+
+	if (p == NULL)
+		return;
+	r->events++;
+	_sim_analyze_advance(r, clock);
+	if (cpu + 1 > r->ncpus)
+		r->ncpus = cpu + 1;
+
+	if (!p->seen) {
+		p->seen = true;
+		p->created = clock;
+		p->first_run = -1;
+		p->exited = -1;
+		p->since = clock;
+	}
+
+	spent = clock - p->since;
+	switch (p->state) {
+	case SIM_TRACE_READY:
+		p->ready_time += spent;
+		r->nr_ready--;
+		break;
+	case SIM_TRACE_RUNNING:
+		p->run_time += spent;
+		r->nr_running--;
+		break;
+	case SIM_TRACE_BLOCKED:
+		p->blocked_time += spent;
+		break;
+	case SIM_TRACE_LOCKWAIT:
+		p->lock_time += spent;
+		break;
+	default:
+		break;
+	}
+
+	switch (to) {
+	case SIM_TRACE_READY:
+		r->nr_ready++;
+		break;
+	case SIM_TRACE_RUNNING:
+		r->nr_running++;
+		p->dispatches++;
+		if (p->first_run < 0)
+			p->first_run = clock;
+		break;
+	case SIM_TRACE_NOEXIST:
+		p->exited = clock;
+		break;
+	default:
+		break;
+	}
+	p->state = to;
+	p->since = clock;
+}
+
+/* ---
+ * text log: "<sec>.<msec> Process#<pid>[.<tid>][(Prio<n>)] <message>"
+ */
+
+static bool _sim_analyze_prefix(const char *p, const char *end, const char *s, const char **next)
+{
+	size_t n = strlen(s);
+
+	if ((size_t)(end - p) < n || memcmp(p, s, n) != 0)
+		return false;
+	*next = p + n;
+	return true;
+}
+
+static enum sim_trace_pstate _sim_analyze_statename(const char *p, const char *end)
+{
+	const char *q;
+
+	if (_sim_analyze_prefix(p, end, "READY", &q))
+		return SIM_TRACE_READY;
+	if (_sim_analyze_prefix(p, end, "RUNNING", &q))
+		return SIM_TRACE_RUNNING;
+	if (_sim_analyze_prefix(p, end, "BLOCKED", &q))
+		return SIM_TRACE_BLOCKED;
+	if (_sim_analyze_prefix(p, end, "LOCKWAIT", &q))
+		return SIM_TRACE_LOCKWAIT;
+	return SIM_TRACE_NOEXIST;
+}
+
+static void _sim_analyze_line(struct sim_analyze_run *r, const char *p, const char *end)
+{
+	long long clock = 0;
+	int pid = 0;
+	const char *q;
+
+	if (p >= end || *p < '0' || *p > '9')
+		return;
+	while (p < end && *p >= '0' && *p <= '9')
+		clock = clock * 10 + (*p++ - '0');
+	if (p >= end || *p++ != '.')
+		return;
+	/* three digits of milliseconds and a space; anything shorter is not a log line */
+	if (end - p < 4)
+		return;
+	clock *= 1000;
+	clock += (p[0] - '0') * 100 + (p[1] - '0') * 10 + (p[2] - '0');
+	p += 4;
+
+	if (!_sim_analyze_prefix(p, end, "Process#", &p))
+		return;
+	while (p < end && *p >= '0' && *p <= '9')
+		pid = pid * 10 + (*p++ - '0');
+	if (p < end && *p == '.') {	/* a thread: the same track id as in binary traces */
+		int tid = 0;
+
+		while (++p < end && *p >= '0' && *p <= '9')
+			tid = tid * 10 + (*p - '0');
+		pid += tid << SIM_TRACE_TID_SHIFT;
+	}
+	q = memchr(p, ' ', end - p);
+	if (q == NULL)
+		return;
+	p = q + 1;
+
+	if (_sim_analyze_prefix(p, end, "Created as state ", &q)) {
+		/* cluster jobs are created BLOCKED until they arrive */
+		_sim_analyze_state(r, clock, pid, 0, _sim_analyze_statename(q, end));
+	} else if (_sim_analyze_prefix(p, end, "Created", &q)) {
+		_sim_analyze_state(r, clock, pid, 0, SIM_TRACE_READY);
+	} else if (_sim_analyze_prefix(p, end, "Terminated", &q)) {
+		_sim_analyze_state(r, clock, pid, 0, SIM_TRACE_NOEXIST);
+	} else if (_sim_analyze_prefix(p, end, "[Trace] State change ", &p)) {
+		const char *c = q = memchr(p, '>', end - p);
+		int cpu = 0;
+
+		if (q == NULL)
+			return;
+		/* multi-CPU runs log "READY->RUNNING on CPU#n" */
+		while (c != NULL && (c = memchr(c, '#', end - c)) != NULL) {
+			if (c - q > 4 && memcmp(c - 4, " CPU", 4) == 0) {
+				while (++c < end && *c >= '0' && *c <= '9')
+					cpu = cpu * 10 + (*c - '0');
+				break;
+			}
+			c++;
+		}
+		_sim_analyze_state(r, clock, pid, cpu, _sim_analyze_statename(q + 1, end));
+	}
+}
+
+static void _sim_analyze_text(struct sim_analyze_run *r, const char *buf, size_t len)
+{
+	const char *p = buf, *end = buf + len, *nl;
+
+	while (p < end) {
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL)
+			nl = end;
+		_sim_analyze_line(r, p, nl);
+		p = nl + 1;
+	}
+}
+
+/* ---
+ * binary trace: columns are scanned in place from the mapping
+ */
+
+static int _sim_analyze_bin(struct sim_analyze_run *r, const char *buf, size_t len)
+{
+	const char *p = buf + 8, *end = buf + len;
+	uint64_t n, i;
+
+	while (p + sizeof(n) <= end) {
+		const int64_t *clock;
+		const int32_t *pid;
+		const uint8_t *type, *cpu, *to;
+
+		memcpy(&n, p, sizeof(n));
+		p += sizeof(n);
+		if ((size_t)(end - p) < (size_t)n * (8 + 4 + 4 + 4))
+			return 0;
+		clock = (const int64_t *)p;
+		pid = (const int32_t *)(p + (size_t)n * 8);
+		type = (const uint8_t *)(p + (size_t)n * 16);
+		cpu = type + n;
+		to = type + 3 * n;
+		for (i = 0; i < n; i++) {
+			if (type[i] == SIM_TRACE_REC_STATE)
+				_sim_analyze_state(r, clock[i], pid[i], cpu[i], to[i]);
+		}
+		p += (size_t)n * (8 + 4 + 4 + 4);
+	}
+
+	return 1;
+}
+
+static int sim_analyze_file(struct sim_analyze_run *r, const char *path)
+{
+	struct stat st;
+	char *buf;
+	int fd, ret = 1;
+
+	r->path = path;
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		return 0;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return 1;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		perror(path);
+		return 0;
+	}
+	madvise(buf, st.st_size, MADV_SEQUENTIAL);
+
+	if (st.st_size >= 8 && memcmp(buf, SIM_TRACE_BIN_MAGIC, 8) == 0)
+		ret = _sim_analyze_bin(r, buf, st.st_size);
+	else
+		_sim_analyze_text(r, buf, st.st_size);
+	if (!ret)
+		fprintf(stderr, "%s: truncated binary trace\n", path);
+
+	munmap(buf, st.st_size);
+	return ret;
+}
+
+static double _sim_analyze_sec(long long t)
+{
+	return t / 1000.0;
+}
+
+/* "#pid", or "#pid.tid" for a later thread of a multi-threaded process */
+static const char *_sim_analyze_name(int pid)
+{
+	static char name[32];
+
+	if (pid >> SIM_TRACE_TID_SHIFT)
+		snprintf(name, sizeof(name), "#%d.%d", pid & ((1 << SIM_TRACE_TID_SHIFT) - 1), pid >> SIM_TRACE_TID_SHIFT);
+	else
+		snprintf(name, sizeof(name), "#%d", pid);
+	return name;
+}
+
+static void sim_analyze_report(struct sim_analyze_run *r)
+{
+	long long total = 0, weighted = 0, i;
+	int pid, n = 0;
+	double turnaround = 0, wait = 0, response = 0;
+
+	printf("== %s: %lld events, end %.3fs, %d CPU(s)\n", r->path, r->events, _sim_analyze_sec(r->clock), r->ncpus);
+
+	printf("%-8s %10s %10s %10s %10s %10s %10s %6s\n", "Process", "Turnaround", "Wait", "Response", "CPU", "Blocked", "Lock", "Disp");
+	for (pid = 0; pid < r->nprocs; pid++) {
+		struct sim_analyze_proc *p = &r->procs[pid];
+
+		if (!p->seen)
+			continue;
+		printf("%-8s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %6d\n", _sim_analyze_name(pid),
+			p->exited >= 0 ? _sim_analyze_sec(p->exited - p->created) : -1.0,
+			_sim_analyze_sec(p->ready_time),
+			p->first_run >= 0 ? _sim_analyze_sec(p->first_run - p->created) : -1.0,
+			_sim_analyze_sec(p->run_time), _sim_analyze_sec(p->blocked_time),
+			_sim_analyze_sec(p->lock_time), p->dispatches);
+		if (p->exited >= 0) {
+			turnaround += p->exited - p->created;
+			wait += p->ready_time;
+			response += p->first_run - p->created;
+			n++;
+		}
+	}
+	if (n > 0)
+		printf("%-8s %10.3f %10.3f %10.3f\n", "mean", turnaround / n / 1000, wait / n / 1000, response / n / 1000);
+
+	printf("-- CPU utilization per %.3fs window\n", _sim_analyze_sec(r->window));
+	for (i = 0; i * r->window < r->clock; i++) {
+		long long len = (i + 1) * r->window < r->clock ? r->window : r->clock - i * r->window;
+		long long busy = i < r->nwindows ? r->busy[i] : 0;
+
+		printf("%8.3f %6.1f%%\n", _sim_analyze_sec(i * r->window), 100.0 * busy / ((double)len * r->ncpus));
+	}
+
+	printf("-- Ready queue length distribution (time-weighted)\n");
+	for (i = 0; i < r->qlen_cap && i <= r->qlen_max; i++) {
+		total += r->qlen_time[i];
+		weighted += r->qlen_time[i] * i;
+	}
+	for (i = 0; i < r->qlen_cap && i <= r->qlen_max; i++) {
+		if (r->qlen_time[i] > 0)
+			printf("%8lld %6.1f%%\n", i, 100.0 * r->qlen_time[i] / total);
+	}
+	if (total > 0)
+		printf("%8s %6.2f\n", "mean", (double)weighted / total);
+}
+
+/* A delta column, or "-" when a process never reached that point in one of the runs */
+static void _sim_analyze_delta(bool known, long long delta)
+{
+	if (known)
+		printf(" %+12.3f", _sim_analyze_sec(delta));
+	else
+		printf(" %12s", "-");
+}
+
+static void sim_analyze_diff(struct sim_analyze_run *a, struct sim_analyze_run *b)
+{
+	int pid, nprocs = a->nprocs > b->nprocs ? a->nprocs : b->nprocs;
+
+	printf("== diff: %s -> %s\n", a->path, b->path);
+	printf("%-8s %12s %12s %12s %12s\n", "Process", "dTurnaround", "dWait", "dResponse", "dCPU");
+	for (pid = 0; pid < nprocs; pid++) {
+		struct sim_analyze_proc *p = pid < a->nprocs ? &a->procs[pid] : NULL;
+		struct sim_analyze_proc *q = pid < b->nprocs ? &b->procs[pid] : NULL;
+
+		if (p == NULL || q == NULL || !p->seen || !q->seen) {
+			if ((p != NULL && p->seen) || (q != NULL && q->seen))
+				printf("%-8s %12s\n", _sim_analyze_name(pid), "(only in one run)");
+			continue;
+		}
+		printf("%-8s", _sim_analyze_name(pid));
+		_sim_analyze_delta(p->exited >= 0 && q->exited >= 0, (q->exited - q->created) - (p->exited - p->created));
+		_sim_analyze_delta(true, q->ready_time - p->ready_time);
+		_sim_analyze_delta(p->first_run >= 0 && q->first_run >= 0, (q->first_run - q->created) - (p->first_run - p->created));
+		_sim_analyze_delta(true, q->run_time - p->run_time);
+		printf("\n");
+	}
+	printf("%-8s %+12.3f\n", "makespan", _sim_analyze_sec(b->clock - a->clock));
+}
+
+int main(int argc, char **argv)
+{
+	struct sim_analyze_run run[2];
+	int opt, i, nruns;
+	long long window = SIM_ANALYZE_WINDOW;
+
+	while ((opt = getopt(argc, argv, "w:")) != -1) {
+		switch (opt) {
+		case 'w':
+			window = strtoll(optarg, NULL, 0);
+			if (window <= 0)
+				window = SIM_ANALYZE_WINDOW;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-w window] trace [trace2]\n", argv[0]);
+			return 1;
+		}
+	}
+	nruns = argc - optind;
+	if (nruns < 1 || nruns > 2) {
+		fprintf(stderr, "usage: %s [-w window] trace [trace2]\n", argv[0]);
+		return 1;
+	}
+
+	memset(run, 0, sizeof(run));
+	for (i = 0; i < nruns; i++) {
+		run[i].window = window;
+		run[i].ncpus = 1;
+		if (!sim_analyze_file(&run[i], argv[optind + i]))
+			return 1;
+		sim_analyze_report(&run[i]);
+	}
+	if (nruns == 2)
+		sim_analyze_diff(&run[0], &run[1]);
+
+	return 0;
+}
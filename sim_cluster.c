@@ -0,0 +1,278 @@
+// 文件名: sim_cluster.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#include "sim_cluster.h"
+
+/* --- 集群: 前端分派器 (-w cluster -N nodes) --- */
+/*
+ * 作业按泊松过程到达前端，前端按 -d 指定的策略选一个节点，经过网络延迟后
+ * 作业进入该节点的运行队列。节点是同一个引擎上的 CPU 分区，共享一个时钟。
+ */
+
+const char *dispatch_policy_names[] = {
+    [DISPATCH_RANDOM] = "random",
+    [DISPATCH_RR] = "rr",
+    [DISPATCH_LEAST] = "least",
+    [DISPATCH_P2C] = "p2c",
+    [DISPATCH_JIQ] = "jiq",
+};
+
+enum sim_dispatch_policy dispatch_policy = DISPATCH_RANDOM;
+struct sim_rand cluster_rand; // 前端自己的随机数流 (seed, 0)
+int net_latency = 2;          // 前端到节点的网络延迟
+int net_latency_exp = 0;      // 延迟服从均值为 net_latency 的指数分布
+int job_interarrival = 20;    // 作业平均到达间隔
+int nr_jobs = 200;
+int node_jobs[SIM_MAXNODES];
+int rr_next = 0;
+int jiq[SIM_MAXNODES], jiq_head = 0, jiq_len = 0;
+bool jiq_member[SIM_MAXNODES];
+long long *job_resp = NULL; // 已完成作业的响应时间 (到达前端到退出)
+int nr_job_resp = 0;
+struct sim_rand_empirical job_service; // -S: 作业每段 CPU burst 的经验分布，count 为 0 时用对数正态
+int jobs_created = 0; // -w cluster 已创建的作业数
+int jobs_dropped = 0; // 到达时进程表已满、被丢弃的作业数
+long long job_pending = -1; // 进程表满、还没能创建的下一个作业的到达时刻
+
+/* delay 是到达时刻与当前时刻之差，必须与引擎的时钟同一类型，否则长间隔会被截断 */
+_Static_assert(_Generic(sim_engine_getclock(), long long: 1, default: 0), "sim_createjob delay must match the engine clock");
+
+/*
+ * 集群作业: 创建后处于 BLOCKED，delay 之后到达前端，由 sim_cluster_dispatch 分派到节点。
+ * 进程表满时返回 0，由调用者决定怎么处理这次到达。
+ */
+int sim_createjob(void (*func)(void), long long delay) {
+    struct sim_proc *proc_p = sim_allocproc(func, PRIORITY_NORMAL, NULL);
+    char log_msg[100];
+
+    if (proc_p == NULL)
+        return 0;
+    proc_p->proc_node = -1;
+    sim_proc_setstate(proc_p, BLOCKED);
+    TAILQ_INSERT_TAIL(&blocked_queue, proc_p, proc_list);
+    sim_cpustate_sleep(&proc_p->proc_cpustate, delay);
+
+    sprintf(log_msg, "Created as state BLOCKED (job arriving in %lld)", delay);
+    sim_logging(proc_p, log_msg);
+    jobs_created++;
+
+    return proc_p->proc_pid;
+}
+
+int sim_cluster_load(int node) {
+    return node_load[node] + node_inflight[node];
+}
+
+int sim_cluster_pick(void) {
+    int n, a, b, best;
+
+    switch (dispatch_policy) {
+    case DISPATCH_RR:
+        n = rr_next;
+        rr_next = (rr_next + 1) % nr_nodes;
+        return n;
+    case DISPATCH_LEAST:
+        best = 0;
+        for (n = 1; n < nr_nodes; n++) {
+            if (sim_cluster_load(n) < sim_cluster_load(best))
+                best = n;
+        }
+        return best;
+    case DISPATCH_P2C:
+        if (nr_nodes == 1)
+            return 0;
+        a = sim_rand_range(&cluster_rand, 0, nr_nodes - 1);
+        b = sim_rand_range(&cluster_rand, 0, nr_nodes - 2);
+        if (b >= a)
+            b++;
+        return sim_cluster_load(b) < sim_cluster_load(a) ? b : a;
+    case DISPATCH_JIQ:
+        if (jiq_len > 0) {
+            n = jiq[jiq_head];
+            jiq_head = (jiq_head + 1) % SIM_MAXNODES;
+            jiq_len--;
+            jiq_member[n] = false;
+            return n;
+        }
+        /* fall through */
+    default:
+        return sim_rand_range(&cluster_rand, 0, nr_nodes - 1);
+    }
+}
+
+/* 节点的所有 CPU 都空闲、也没有在途作业时，向前端的空闲队列报到 */
+void sim_cluster_idle(int node) {
+    int c;
+
+    if (dispatch_policy != DISPATCH_JIQ || jiq_member[node] ||
+        node_load[node] > 0 || node_inflight[node] > 0)
+        return;
+    for (c = node * cpus_per_node; c < (node + 1) * cpus_per_node; c++) {
+        if (cpu_curr[c] != NULL)
+            return;
+    }
+    jiq[(jiq_head + jiq_len) % SIM_MAXNODES] = node;
+    jiq_len++;
+    jiq_member[node] = true;
+}
+
+void sim_proc_job(void) {
+    int phases = sim_rand_range(&activeproc->proc_rand, 1, 3);
+    int i;
+
+    for (i = 0; i < phases; i++) {
+        if (i > 0)
+            sim_iorequest(sim_rand_range(&activeproc->proc_rand, 10, 40));
+        if (job_service.count > 0)
+            sim_cpuburst(sim_rand_burst(sim_rand_empirical(&activeproc->proc_rand, &job_service)));
+        else
+            sim_cpuburst(sim_rand_burst(sim_rand_lognormal(&activeproc->proc_rand, log(20), 0.8)));
+    }
+}
+
+/*
+ * -S: 从文件读入服务时间表，每行 "burst 权重"，例如从生产 trace 统计出的
+ * burst 长度直方图。# 开头的行和空行跳过。
+ */
+int sim_service_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    double *value = NULL, *weight = NULL;
+    double v, w;
+    char line[200];
+    int n = 0;
+
+    if (fp == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+            continue;
+        if (sscanf(line, "%lf %lf", &v, &w) != 2 || v < 0 || w < 0) {
+            fclose(fp);
+            free(value);
+            free(weight);
+            errno = EINVAL;
+            return 0;
+        }
+        if (n % 64 == 0) {
+            value = realloc(value, (n + 64) * sizeof(*value));
+            weight = realloc(weight, (n + 64) * sizeof(*weight));
+        }
+        value[n] = v;
+        weight[n] = w;
+        n++;
+    }
+    fclose(fp);
+    if (n == 0) {
+        errno = EINVAL;
+        return 0;
+    }
+    job_service.count = n;
+    job_service.value = value;
+    job_service.weight = weight;
+    return 1;
+}
+
+/* 作业到达前端 (devioready 上下文): 选节点，经过网络延迟后到达节点 */
+void sim_cluster_dispatch(struct sim_proc *proc_p) {
+    int node = sim_cluster_pick();
+    int latency = net_latency_exp ? sim_rand_burst(sim_rand_exp(&cluster_rand, net_latency)) : net_latency;
+    char log_msg[100];
+
+    proc_p->arrival_time = sim_engine_getclock();
+    /* 作业的随机数流从前端的流分出: 只取决于到达次序，与分到哪个进程表槽位无关 */
+    sim_rand_split(&cluster_rand, &proc_p->proc_rand);
+    proc_p->proc_node = node;
+    proc_p->proc_cpu = node * cpus_per_node;
+    proc_p->in_flight = true;
+    node_inflight[node]++;
+    node_jobs[node]++;
+    sprintf(log_msg, "[Trace] Dispatched to node#%d (%s, network latency %d)",
+        node, dispatch_policy_names[dispatch_policy], latency);
+    sim_logging(proc_p, log_msg);
+    sim_cpustate_sleep(&proc_p->proc_cpustate, latency);
+
+    sim_cluster_next(sim_engine_getclock() + sim_rand_burst(sim_rand_exp(&cluster_rand, job_interarrival)));
+}
+
+/*
+ * 创建下一个在 arrival 到达的作业。进程表满时记下到达时刻，等有作业退出、
+ * 腾出槽位时再创建；那时到达时刻已经过去的作业都算丢弃 (期间进程表一直是
+ * 满的)，接着抽下一个到达间隔，到达流不会因为一次丢弃而中断。
+ */
+void sim_cluster_next(long long arrival) {
+    long long clock = sim_engine_getclock();
+    char log_msg[100];
+
+    job_pending = -1;
+    while (jobs_created + jobs_dropped < nr_jobs) {
+        if (arrival >= clock) {
+            if (!sim_createjob(sim_proc_job, arrival - clock))
+                job_pending = arrival;
+            return;
+        }
+        jobs_dropped++;
+        sprintf(log_msg, "[Error] Job arriving at %lld.%03lld dropped: process table full", arrival / 1000, arrival % 1000);
+        sim_logging(NULL, log_msg);
+        arrival += sim_rand_burst(sim_rand_exp(&cluster_rand, job_interarrival));
+    }
+}
+
+void sim_cluster_done(struct sim_proc *proc_p) {
+    if (nr_job_resp % 256 == 0)
+        job_resp = realloc(job_resp, (nr_job_resp + 256) * sizeof(*job_resp));
+    job_resp[nr_job_resp++] = sim_engine_getclock() - proc_p->arrival_time;
+}
+
+int sim_time_cmp(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+void sim_cluster_report(void) {
+    long long clock = sim_engine_getclock();
+    double mean_load = 0, max_load = 0, load;
+    long long total = 0, busy;
+    int n, c, i;
+    char log_msg[200];
+
+    sim_node_account(0, 0);
+    sprintf(log_msg, "[Stats] cluster: %d nodes x %d CPUs, dispatch %s, network latency %s%d, %d jobs, %d dropped, mean interarrival %d",
+        nr_nodes, cpus_per_node, dispatch_policy_names[dispatch_policy], net_latency_exp ? "exp:" : "",
+        net_latency, nr_job_resp, jobs_dropped, job_interarrival);
+    sim_logging(NULL, log_msg);
+    if (nr_job_resp > 0) {
+        qsort(job_resp, nr_job_resp, sizeof(*job_resp), sim_time_cmp);
+        for (i = 0; i < nr_job_resp; i++)
+            total += job_resp[i];
+        sprintf(log_msg, "[Stats] job response: mean %.1f p50 %lld p95 %lld p99 %lld max %lld",
+            (double)total / nr_job_resp, job_resp[nr_job_resp / 2], job_resp[nr_job_resp * 95 / 100],
+            job_resp[nr_job_resp * 99 / 100], job_resp[nr_job_resp - 1]);
+        sim_logging(NULL, log_msg);
+    }
+    for (n = 0; n < nr_nodes; n++) {
+        load = clock > 0 ? (double)node_load_area[n] / clock : 0.0;
+        mean_load += load / nr_nodes;
+        if (load > max_load)
+            max_load = load;
+        busy = 0;
+        for (c = n * cpus_per_node; c < (n + 1) * cpus_per_node; c++)
+            busy += sim_engine_cpu_busytime(c);
+        sprintf(log_msg, "[Stats] node#%d: %d jobs, avg load %.2f, utilization %.1f%%",
+            n, node_jobs[n], load, clock > 0 ? 100.0 * busy / ((double)clock * cpus_per_node) : 0.0);
+        sim_logging(NULL, log_msg);
+    }
+    sprintf(log_msg, "[Stats] load imbalance: max/mean %.2f, mean max-min spread %.2f",
+        mean_load > 0 ? max_load / mean_load : 1.0, clock > 0 ? (double)node_spread_area / clock : 0.0);
+    sim_logging(NULL, log_msg);
+}
+
+/* 集群 workload (-w cluster): nr_jobs 个作业依次到达前端 */
+void sim_workload_cluster(void) {
+    sim_rand_init(&cluster_rand, sim_seed, 0);
+    sim_createjob(sim_proc_job, sim_rand_burst(sim_rand_exp(&cluster_rand, job_interarrival)));
+}
@@ -0,0 +1,36 @@
+// 文件名: sim_cluster.h
+/*
+ * 集群前端 (-w cluster -N nodes): 作业到达前端，按分派策略经过网络延迟
+ * 送到某个节点，退出时记下响应时间。
+ */
+#ifndef SIM_CLUSTER_H
+#define SIM_CLUSTER_H
+
+#include "sim_sched_advanced.h"
+
+enum sim_dispatch_policy {
+    DISPATCH_RANDOM = 0,
+    DISPATCH_RR,
+    DISPATCH_LEAST, // 最少 (可运行 + 在途) 作业
+    DISPATCH_P2C,   // power of two choices: 随机取两个节点，选负载小的
+    DISPATCH_JIQ    // join-idle-queue: 空闲节点向前端报到，没有空闲节点时随机
+};
+
+extern const char *dispatch_policy_names[];
+extern enum sim_dispatch_policy dispatch_policy;
+extern int net_latency;
+extern int net_latency_exp;
+extern int job_interarrival;
+extern int nr_jobs;
+extern long long job_pending;
+
+int sim_createjob(void (*func)(void), long long delay);
+int sim_service_load(const char *path);
+void sim_cluster_idle(int node);
+void sim_cluster_dispatch(struct sim_proc *proc_p);
+void sim_cluster_next(long long arrival);
+void sim_cluster_done(struct sim_proc *proc_p);
+void sim_cluster_report(void);
+void sim_workload_cluster(void);
+
+#endif
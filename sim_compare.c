@@ -0,0 +1,302 @@
+// 文件名: sim_compare.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "sim_compare.h"
+#include "sim_gang.h"
+
+/* --- 对比模式 (-C policy,policy,...) --- */
+/*
+ * 每个策略在一个 fork 出来的子进程中运行同一个 workload。进程的 burst 和
+ * 作业到达都来自按 (seed, stream) 划分的随机数流，与调度无关，所以各个
+ * 策略看到的到达时刻和 burst 序列完全相同。子进程把每个进程的结果写进
+ * 一个临时文件，父进程等所有子进程结束后输出对比报告。
+ */
+#define SIM_MAXCOMPARE 8
+
+/* 一个进程的结果，退出时由子进程写出 */
+struct sim_proc_result {
+    int pid;
+    int priority;
+    long long turnaround;
+    long long response;
+    long long state_time[LOCKWAIT + 1];
+    int dispatches;
+};
+
+/* 一次运行的汇总，写在结果文件末尾 */
+struct sim_run_result {
+    long long makespan;
+    double utilization;
+    double ready_latency; // READY->RUNNING 的平均等待
+    int migrations;
+    double barrier_wait;  // 所有线程在屏障上等待的总时间
+    double fragmentation; // 有进程就绪却空着的 CPU 时间占总 CPU 时间的百分比
+};
+
+struct sim_compare_run {
+    enum sim_sched_policy policy;
+    FILE *fp;
+    pid_t child;
+    int status;
+    struct sim_proc_result *procs; // 按 pid 索引
+    int nprocs;
+    struct sim_run_result run;
+};
+
+struct sim_compare_run compare_runs[SIM_MAXCOMPARE];
+int nr_compare = 0;
+FILE *compare_out = NULL; // -C 的子进程: 结果写给父进程
+
+void sim_compare_record(struct sim_proc *proc_p) {
+    struct sim_thread_group *g = proc_p->group;
+    struct sim_proc_result res;
+
+    memset(&res, 0, sizeof(res));
+    res.pid = proc_p->proc_pid;
+    res.priority = proc_p->base_priority;
+    if (g != NULL) { // 多线程进程: 整个进程的结果，状态时间是所有线程之和
+        res.turnaround = sim_engine_getclock() - g->creation_time;
+        res.response = g->first_run >= 0 ? g->first_run - g->creation_time : -1;
+        memcpy(res.state_time, g->state_time, sizeof(res.state_time));
+        res.dispatches = g->nr_dispatch;
+    } else {
+        res.turnaround = sim_engine_getclock() - proc_p->creation_time;
+        res.response = proc_p->first_run >= 0 ? proc_p->first_run - proc_p->creation_time : -1;
+        memcpy(res.state_time, proc_p->state_time, sizeof(res.state_time));
+        res.dispatches = proc_p->nr_dispatch;
+    }
+    fwrite(&res, sizeof(res), 1, compare_out);
+}
+
+int sim_compare_parse(const char *list) {
+    char buf[100], *tok, *save;
+    int i;
+
+    snprintf(buf, sizeof(buf), "%s", list);
+    for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        for (i = 0; i <= SCHED_COSCHED; i++) {
+            if (strcmp(tok, sched_policy_names[i]) == 0)
+                break;
+        }
+        if (i > SCHED_COSCHED || nr_compare >= SIM_MAXCOMPARE)
+            return 0;
+        compare_runs[nr_compare++].policy = i;
+    }
+    return nr_compare > 0;
+}
+
+/* -C 的策略中有没有 policy */
+bool sim_compare_has(enum sim_sched_policy policy) {
+    int i;
+
+    for (i = 0; i < nr_compare; i++) {
+        if (compare_runs[i].policy == policy)
+            return true;
+    }
+    return false;
+}
+
+/* 读回一个子进程的结果: n 个进程记录，最后是运行汇总 */
+int sim_compare_load(struct sim_compare_run *r) {
+    struct sim_proc_result res;
+    long size;
+    int n;
+
+    if (!WIFEXITED(r->status) || WEXITSTATUS(r->status) != 0)
+        return 0;
+    fseek(r->fp, 0, SEEK_END);
+    size = ftell(r->fp) - (long)sizeof(r->run);
+    if (size < 0 || size % sizeof(res) != 0)
+        return 0;
+    rewind(r->fp);
+    for (n = size / sizeof(res); n > 0; n--) {
+        if (fread(&res, sizeof(res), 1, r->fp) != 1)
+            return 0;
+        if (res.pid >= r->nprocs) {
+            r->procs = realloc(r->procs, (res.pid + 1) * sizeof(*r->procs));
+            memset(r->procs + r->nprocs, 0, (res.pid + 1 - r->nprocs) * sizeof(*r->procs));
+            r->nprocs = res.pid + 1;
+        }
+        r->procs[res.pid] = res;
+    }
+    return fread(&r->run, sizeof(r->run), 1, r->fp) == 1;
+}
+
+/* 一行对比: 每个策略的值，后面的策略附上相对第一个策略的差 */
+void sim_compare_row(const char *name, const double *v, int n) {
+    int i;
+
+    printf("%-18s %10.3f", name, v[0]);
+    for (i = 1; i < n; i++)
+        printf(" %10.3f (%+8.3f)", v[i], v[i] - v[0]);
+    printf("\n");
+}
+
+void sim_compare_header(const char *name) {
+    int i;
+
+    printf("%-18s %10s", name, sched_policy_names[compare_runs[0].policy]);
+    for (i = 1; i < nr_compare; i++)
+        printf(" %10s %10s", sched_policy_names[compare_runs[i].policy], "(delta)");
+    printf("\n");
+}
+
+/* 一个策略下所有进程的平均周转、等待、响应时间和总调度次数 */
+void sim_compare_means(struct sim_compare_run *r, double *turnaround, double *wait, double *response, double *dispatches) {
+    int pid, n = 0;
+
+    *turnaround = *wait = *response = *dispatches = 0;
+    for (pid = 0; pid < r->nprocs; pid++) {
+        struct sim_proc_result *p = &r->procs[pid];
+
+        if (p->pid == 0)
+            continue;
+        *turnaround += p->turnaround;
+        *wait += p->state_time[READY];
+        *response += p->response;
+        *dispatches += p->dispatches;
+        n++;
+    }
+    if (n > 0) {
+        *turnaround /= n * 1000.0;
+        *wait /= n * 1000.0;
+        *response /= n * 1000.0;
+    }
+}
+
+void sim_compare_report(const char *workload) {
+    double turnaround[SIM_MAXCOMPARE], wait[SIM_MAXCOMPARE], response[SIM_MAXCOMPARE], dispatches[SIM_MAXCOMPARE];
+    double v[SIM_MAXCOMPARE] = {0};
+    int i, pid, nprocs = 0;
+    char name[32];
+
+    for (i = 0; i < nr_compare; i++) {
+        sim_compare_means(&compare_runs[i], &turnaround[i], &wait[i], &response[i], &dispatches[i]);
+        if (compare_runs[i].nprocs > nprocs)
+            nprocs = compare_runs[i].nprocs;
+    }
+
+    printf("== compare: workload %s, seed %llu, deltas against %s\n",
+        workload, sim_seed, sched_policy_names[compare_runs[0].policy]);
+    sim_compare_header("metric");
+    for (i = 0; i < nr_compare; i++)
+        v[i] = compare_runs[i].run.makespan / 1000.0;
+    sim_compare_row("makespan", v, nr_compare);
+    for (i = 0; i < nr_compare; i++)
+        v[i] = compare_runs[i].run.utilization;
+    sim_compare_row("CPU utilization %", v, nr_compare);
+    sim_compare_row("mean turnaround", turnaround, nr_compare);
+    sim_compare_row("mean wait", wait, nr_compare);
+    sim_compare_row("mean response", response, nr_compare);
+    for (i = 0; i < nr_compare; i++)
+        v[i] = compare_runs[i].run.ready_latency;
+    sim_compare_row("mean READY->RUN", v, nr_compare);
+    sim_compare_row("dispatches", dispatches, nr_compare);
+    for (i = 0; i < nr_compare; i++)
+        v[i] = compare_runs[i].run.migrations;
+    sim_compare_row("migrations", v, nr_compare);
+    for (i = 0; i < nr_compare && compare_runs[i].run.barrier_wait == 0; i++)
+        ;
+    if (i < nr_compare) { // 有多线程进程时才有屏障和碎片
+        for (i = 0; i < nr_compare; i++)
+            v[i] = compare_runs[i].run.barrier_wait;
+        sim_compare_row("barrier wait", v, nr_compare);
+        for (i = 0; i < nr_compare; i++)
+            v[i] = compare_runs[i].run.fragmentation;
+        sim_compare_row("fragmentation %", v, nr_compare);
+    }
+
+    printf("-- per process: turnaround / wait (READY time)\n");
+    sim_compare_header("process");
+    for (pid = 1; pid < nprocs; pid++) {
+        struct sim_proc_result *p = NULL;
+
+        for (i = 0; i < nr_compare; i++) {
+            if (pid < compare_runs[i].nprocs && compare_runs[i].procs[pid].pid == pid)
+                p = &compare_runs[i].procs[pid];
+            else
+                break;
+        }
+        if (i < nr_compare) {
+            if (p != NULL || i > 0)
+                printf("#%-17d (did not finish under every policy)\n", pid);
+            continue;
+        }
+        sprintf(name, "#%d (Prio%d)", pid, p->priority);
+        for (i = 0; i < nr_compare; i++)
+            v[i] = compare_runs[i].procs[pid].turnaround / 1000.0;
+        sim_compare_row(name, v, nr_compare);
+        for (i = 0; i < nr_compare; i++)
+            v[i] = compare_runs[i].procs[pid].state_time[READY] / 1000.0;
+        sim_compare_row("  wait", v, nr_compare);
+    }
+}
+
+/*
+ * 为每个策略 fork 一个子进程。在子进程中返回 -1，子进程接着按自己的策略
+ * 运行 workload；在父进程中等所有子进程结束、输出报告后返回退出码。
+ */
+int sim_compare_run(const char *prog, const char *workload) {
+    int i, ret = 0;
+
+    fflush(stdout);
+    for (i = 0; i < nr_compare; i++) {
+        struct sim_compare_run *r = &compare_runs[i];
+
+        r->fp = tmpfile();
+        if (r->fp == NULL) {
+            perror(prog);
+            return 1;
+        }
+        r->child = fork();
+        if (r->child < 0) {
+            perror(prog);
+            return 1;
+        }
+        if (r->child == 0) {
+            if (freopen("/dev/null", "w", stdout) == NULL)
+                _exit(1);
+            sched_policy = r->policy;
+            compare_out = r->fp;
+            return -1;
+        }
+    }
+
+    for (i = 0; i < nr_compare; i++) {
+        struct sim_compare_run *r = &compare_runs[i];
+
+        waitpid(r->child, &r->status, 0);
+        if (!sim_compare_load(r)) {
+            fprintf(stderr, "%s: policy %s did not complete\n", prog, sched_policy_names[r->policy]);
+            ret = 1;
+        }
+    }
+    if (ret == 0)
+        sim_compare_report(workload);
+    return ret;
+}
+
+/* -C 的子进程: 在所有进程的结果之后写出运行汇总 */
+void sim_compare_finish(void) {
+    struct sim_run_result run;
+    long long total = 0;
+    int prio, count = 0;
+
+    for (prio = PRIORITY_HIGH; prio <= PRIORITY_LOW; prio++) {
+        total += resp_total[prio];
+        count += resp_count[prio];
+    }
+    run.makespan = sim_engine_getclock();
+    run.utilization = sim_cpu_utilization();
+    run.ready_latency = count > 0 ? (double)total / count / 1000 : 0.0;
+    run.migrations = nr_migrations;
+    sim_frag_integrate(run.makespan);
+    run.barrier_wait = barrier_wait_total / 1000.0;
+    run.fragmentation = run.makespan > 0 ? 100.0 * frag_area / ((double)run.makespan * nr_cpus) : 0.0;
+    fwrite(&run, sizeof(run), 1, compare_out);
+    fclose(compare_out);
+}
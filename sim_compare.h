@@ -0,0 +1,20 @@
+// 文件名: sim_compare.h
+/*
+ * 对比模式 (-C policy,policy,...): 每个调度策略在一个子进程中运行同一个
+ * workload，父进程汇总各策略的结果输出对比报告。
+ */
+#ifndef SIM_COMPARE_H
+#define SIM_COMPARE_H
+
+#include "sim_sched_advanced.h"
+
+extern int nr_compare;
+extern FILE *compare_out;
+
+int sim_compare_parse(const char *list);
+bool sim_compare_has(enum sim_sched_policy policy);
+int sim_compare_run(const char *prog, const char *workload);
+void sim_compare_record(struct sim_proc *proc_p);
+void sim_compare_finish(void);
+
+#endif
@@ -6,8 +6,9 @@
 #include <sys/queue.h>
 
 #include "sim_engine.h"
+#include "sim_prof.h"
 
-int sim_engine_clock = 0;
+long long sim_engine_clock = 0;
 int sim_engine_procs_count = 0;
 sem_t sim_engine_running;
 
@@ -16,8 +17,12 @@ struct sim_engine_proc_cb {
 	sem_t cpusem;
 	pthread_t tid;
 	struct sim_cpustate *cpustate_p;
-	int ioready_clock;
-	int cpu_maxburst;
+	long long ioready_clock;
+	bool iodevice;	/* waiting for a device, not a timer (sim_cpustate_sleep) */
+	long long cpu_maxburst;
+	bool cpu_sliced;	/* cpu_maxburst is a limit (0 then means exhausted) */
+	int cpu;	/* CPU the process is dispatched on, -1 if none */
+	long long rem;	/* work left in the current burst, 0 if not in a burst */
 	void (*proc_func)(void);
 	TAILQ_ENTRY(sim_engine_proc_cb) proc_list;
 };
@@ -30,6 +35,307 @@ TAILQ_HEAD(sim_engine_iowait, sim_engine_proc_cb) sim_engine_iowait = TAILQ_HEAD
 pthread_attr_t sim_engine_tattr;
 pthread_key_t sim_engine_tkey_proc_cb;
 
+/* ---
+ * CPUs
+ *
+ * Only one thread runs at a time (the baton is passed with the cpusem
+ * semaphores), but several processes can be in a burst at once, one per
+ * CPU. Whichever thread holds the baton and has nothing to run drives
+ * _sim_engine_run(), which advances the clock to the earliest burst end,
+ * slice end, I/O completion or governor sample over all CPUs.
+ */
+
+const struct sim_engine_cputype sim_engine_cpu_big = { "big", 100, 100 };
+const struct sim_engine_cputype sim_engine_cpu_little = { "little", 50, 25 };
+
+struct sim_engine_cpu {
+	struct sim_engine_cputype type;
+	struct sim_engine_proc_cb *curr;	/* dispatched process, NULL if idle */
+	long long idle_since;
+	long long busy_time;
+	long long gov_busy;	/* busy_time at the last governor sample */
+	bool gov_wasbusy;	/* busy throughout the last sampled period */
+	long long sys_time;	/* part of busy_time spent on system work */
+	long long sys_work;	/* system work pending, see sim_engine_syscharge() */
+};
+
+struct sim_engine_cpu sim_engine_cpus[SIM_ENGINE_MAXCPUS] = {
+	{ .type = { "big", 100, 100 } },
+};
+int sim_engine_ncpus = 1;
+/* CPU whose process holds the baton, or whose interrupt is being handled */
+int sim_engine_curcpu = 0;
+/* Nesting depth of callbacks made from the event loop */
+int sim_engine_intr = 0;
+
+/* Work is kept in 1/(100 * 100) units: speed = capacity(%) * frequency speed(%) */
+#define SIM_ENGINE_WORK_SCALE 10000
+/* System work is in ns at full speed: one clock unit at speed s does s * this */
+#define SIM_ENGINE_SYS_NS (1000000 / SIM_ENGINE_WORK_SCALE)
+
+enum sim_engine_event {
+	SIM_EV_BURST = 0,	/* ties at the same clock are handled in this order */
+	SIM_EV_SLICE,
+	SIM_EV_IO,
+	SIM_EV_IRQ,	/* a coalesced batch of I/O completions is delivered */
+	SIM_EV_GOV
+};
+
+/* ---
+ * Interrupt coalescing
+ *
+ * By default every I/O completion is its own devioready callback. With
+ * sim_engine_set_coalesce(), a completion is held back until window clock
+ * units after the first pending one, or until count completions are
+ * pending, and the whole batch is delivered as one interrupt (NAPI-style).
+ * A window of 0 batches the completions that fall on the same clock.
+ */
+
+/* Completed I/O requests not yet delivered */
+TAILQ_HEAD(sim_engine_irqpend, sim_engine_proc_cb) sim_engine_irqpend = TAILQ_HEAD_INITIALIZER(sim_engine_irqpend);
+int sim_engine_irq_window = -1;	/* -1: coalescing off */
+int sim_engine_irq_count;
+int sim_engine_irq_npending;
+long long sim_engine_irq_deadline;
+void (*sim_engine_callback_devioready_batch)(void **, int);
+void **sim_engine_irq_batch;
+int sim_engine_irq_batch_cap;
+struct sim_engine_irqstats sim_engine_irq_stats;
+
+/* ---
+ * DVFS and energy model
+ *
+ * sim_cpuburst() takes an amount of work; at speed s (percent of the top
+ * frequency) it takes work * 100 / s clock units. Busy time is charged at
+ * the active power of the current level, idle time (sim_wait_nextintr)
+ * at the deepest idle state whose target residency fits the idle period.
+ * Power is in mW and one clock unit is 1ms.
+ */
+
+const struct sim_engine_freq sim_engine_freqs[SIM_ENGINE_NFREQ] = {
+	{ 40, 300 },
+	{ 60, 550 },
+	{ 80, 950 },
+	{ 100, 1600 },
+};
+
+const struct sim_engine_idlestate sim_engine_idlestates[SIM_ENGINE_NIDLE] = {
+	{ "C1", 0, 200 },
+	{ "C3", 20, 50 },
+	{ "C6", 200, 5 },
+};
+
+#define SIM_GOV_PERIOD 50	/* governor sampling period */
+#define SIM_GOV_UP_THRESHOLD 80	/* ondemand: go to top speed above this load (%) */
+
+int sim_engine_freq = SIM_ENGINE_NFREQ - 1;
+enum sim_engine_governor sim_engine_governor = SIM_GOV_PERFORMANCE;
+long long sim_engine_gov_next = SIM_GOV_PERIOD;
+long long sim_engine_gov_last = 0;
+/*
+ * Fast-forward: a sample only depends on the busy fraction of each CPU
+ * and on the frequency. gov_stable holds if over the last sampled period
+ * every CPU was either busy or idle throughout (gov_wasbusy) and the
+ * frequency was kept; while each CPU stays as it was, the samples that
+ * follow decide the same.
+ */
+bool sim_engine_fastforward = false;
+bool sim_engine_gov_stable = false;
+long long sim_engine_gov_skipped = 0;
+struct sim_engine_energy sim_engine_energy_acct;
+
+static void _sim_engine_busy(int cpu, long long dt)
+{
+	int power = sim_engine_freqs[sim_engine_freq].power * sim_engine_cpus[cpu].type.power / 100;
+
+	sim_engine_cpus[cpu].busy_time += dt;
+	sim_engine_energy_acct.busy_time[sim_engine_freq] += dt;
+	sim_engine_energy_acct.busy_joules += (double)dt * power / 1e6;
+}
+
+/* Deepest idle state whose target residency fits an idle period of dt */
+static int _sim_engine_idlestate(long long dt)
+{
+	int i, state = 0;
+
+	for (i = 0; i < SIM_ENGINE_NIDLE; i++) {
+		if (sim_engine_idlestates[i].residency <= dt)
+			state = i;
+	}
+	return state;
+}
+
+static void _sim_engine_idle(struct sim_engine_energy *acct, int cpu, long long dt)
+{
+	int state = _sim_engine_idlestate(dt);
+	int power = sim_engine_idlestates[state].power * sim_engine_cpus[cpu].type.power / 100;
+
+	acct->idle_time[state] += dt;
+	acct->idle_joules += (double)dt * power / 1e6;
+}
+
+static void _sim_engine_setfreq(int level)
+{
+	if (level < 0)
+		level = 0;
+	if (level >= SIM_ENGINE_NFREQ)
+		level = SIM_ENGINE_NFREQ - 1;
+	if (level != sim_engine_freq)
+		sim_engine_energy_acct.transitions++;
+	sim_engine_freq = level;
+}
+
+/* Lowest level whose speed is at least the given percentage of the top speed */
+static int _sim_engine_freq_for(int speed)
+{
+	int i;
+
+	for (i = 0; i < SIM_ENGINE_NFREQ - 1; i++) {
+		if (sim_engine_freqs[i].speed >= speed)
+			break;
+	}
+	return i;
+}
+
+static void _sim_engine_governor_reset(void)
+{
+	int c;
+
+	for (c = 0; c < sim_engine_ncpus; c++)
+		sim_engine_cpus[c].gov_busy = sim_engine_cpus[c].busy_time;
+	sim_engine_gov_last = sim_engine_clock;
+	sim_engine_gov_next = sim_engine_clock + SIM_GOV_PERIOD;
+}
+
+static void _sim_engine_governor_sample(void)
+{
+	long long elapsed = sim_engine_clock - sim_engine_gov_last;
+	int util = 0, demand, c, level = sim_engine_freq;
+	bool uniform = true;
+
+	if (elapsed <= 0)
+		return;
+	SIM_PROF_BEGIN();
+	/* the shared frequency follows the busiest CPU */
+	for (c = 0; c < sim_engine_ncpus; c++) {
+		long long busy = sim_engine_cpus[c].busy_time - sim_engine_cpus[c].gov_busy;
+		int u = busy * 100 / elapsed;
+
+		if (u > util)
+			util = u;
+		uniform = uniform && (busy == 0 || busy == elapsed);
+		sim_engine_cpus[c].gov_wasbusy = busy == elapsed;
+	}
+	demand = util * sim_engine_freqs[sim_engine_freq].speed / 100;
+
+	switch (sim_engine_governor) {
+	case SIM_GOV_ONDEMAND:
+		if (util > SIM_GOV_UP_THRESHOLD)
+			_sim_engine_setfreq(SIM_ENGINE_NFREQ - 1);
+		else
+			_sim_engine_setfreq(_sim_engine_freq_for(demand * 100 / SIM_GOV_UP_THRESHOLD));
+		break;
+	case SIM_GOV_SCHEDUTIL:
+		_sim_engine_setfreq(_sim_engine_freq_for(demand * 125 / 100));
+		break;
+	default:
+		break;
+	}
+
+	_sim_engine_governor_reset();
+	sim_engine_gov_stable = uniform && level == sim_engine_freq;
+	SIM_PROF_END();
+}
+
+/*
+ * Skip the samples due before the next other event, which is until clock
+ * units away (a sample at that same clock is taken after it), leaving
+ * the governor as if the last skipped one had been taken.
+ */
+static void _sim_engine_governor_skip(long long until)
+{
+	long long end = sim_engine_clock + until, n;
+	int c;
+
+	if (!sim_engine_gov_stable || sim_engine_gov_next >= end)
+		return;
+	/* every CPU must still be as it was, and have been since the last sample */
+	for (c = 0; c < sim_engine_ncpus; c++) {
+		struct sim_engine_cpu *cpu = &sim_engine_cpus[c];
+
+		if ((cpu->curr != NULL) != cpu->gov_wasbusy ||
+		    cpu->busy_time - cpu->gov_busy != (cpu->gov_wasbusy ? sim_engine_clock - sim_engine_gov_last : 0))
+			return;
+	}
+	n = (end - sim_engine_gov_next + SIM_GOV_PERIOD - 1) / SIM_GOV_PERIOD;
+	sim_engine_gov_last = sim_engine_gov_next + (n - 1) * SIM_GOV_PERIOD;
+	sim_engine_gov_next = sim_engine_gov_last + SIM_GOV_PERIOD;
+	for (c = 0; c < sim_engine_ncpus; c++) {
+		sim_engine_cpus[c].gov_busy = sim_engine_cpus[c].busy_time;
+		if (sim_engine_cpus[c].curr != NULL)
+			sim_engine_cpus[c].gov_busy += sim_engine_gov_last - sim_engine_clock;
+	}
+	sim_engine_gov_skipped += n;
+}
+
+void sim_engine_set_fastforward(bool on)
+{
+	sim_engine_fastforward = on;
+}
+
+long long sim_engine_fastforward_skipped(void)
+{
+	return sim_engine_gov_skipped;
+}
+
+void sim_engine_set_governor(enum sim_engine_governor governor)
+{
+	sim_engine_governor = governor;
+	sim_engine_gov_stable = false;
+	if (governor == SIM_GOV_POWERSAVE)
+		_sim_engine_setfreq(0);
+	else if (governor != SIM_GOV_USERSPACE)
+		_sim_engine_setfreq(SIM_ENGINE_NFREQ - 1);
+	_sim_engine_governor_reset();
+}
+
+/* Only honoured by the userspace governor */
+void sim_engine_setfreq(int level)
+{
+	if (sim_engine_governor == SIM_GOV_USERSPACE)
+		_sim_engine_setfreq(level);
+}
+
+int sim_engine_getfreq(void)
+{
+	return sim_engine_freq;
+}
+
+/* Level with the least active energy per unit of work above the C1 idle floor */
+int sim_engine_freq_efficient(void)
+{
+	int i, best = 0;
+
+	for (i = 1; i < SIM_ENGINE_NFREQ; i++) {
+		if ((sim_engine_freqs[i].power - sim_engine_idlestates[0].power) * sim_engine_freqs[best].speed <
+		    (sim_engine_freqs[best].power - sim_engine_idlestates[0].power) * sim_engine_freqs[i].speed)
+			best = i;
+	}
+	return best;
+}
+
+/* Includes the idle periods of CPUs that are still idle */
+void sim_engine_energy(struct sim_engine_energy *energy)
+{
+	int c;
+
+	*energy = sim_engine_energy_acct;
+	for (c = 0; c < sim_engine_ncpus; c++) {
+		if (sim_engine_cpus[c].curr == NULL)
+			_sim_engine_idle(energy, c, sim_engine_clock - sim_engine_cpus[c].idle_since);
+	}
+}
+
 void (*sim_engine_callback_devioready)(void *);
 void (*sim_engine_callback_cpurunout)(void *);
 void (*sim_engine_callback_exit)(void *);
@@ -49,37 +355,342 @@ int sim_engine_init(void (*callback_devioready)(void *), void (*callback_cpuruno
 	return 1;
 }
 
+int sim_engine_setcpus(int ncpus, const struct sim_engine_cputype *types)
+{
+	int c;
+
+	if (ncpus < 1 || ncpus > SIM_ENGINE_MAXCPUS)
+		return 0;
+	for (c = 0; c < ncpus; c++) {
+		sim_engine_cpus[c].type = types[c];
+		sim_engine_cpus[c].curr = NULL;
+		sim_engine_cpus[c].idle_since = sim_engine_clock;
+	}
+	sim_engine_ncpus = ncpus;
+
+	return 1;
+}
+
+int sim_engine_getncpus(void)
+{
+	return sim_engine_ncpus;
+}
+
+/* The caller's CPU in process context, the interrupted CPU in a callback */
+int sim_engine_getcpu(void)
+{
+	return sim_engine_curcpu;
+}
+
+const struct sim_engine_cputype *sim_engine_cputype(int cpu)
+{
+	return &sim_engine_cpus[cpu].type;
+}
+
+long long sim_engine_cpu_busytime(int cpu)
+{
+	return sim_engine_cpus[cpu].busy_time;
+}
+
+long long sim_engine_cpu_systime(int cpu)
+{
+	return sim_engine_cpus[cpu].sys_time;
+}
+
+/*
+ * Charge ns of system work (e.g. a scheduling decision) to a CPU. The
+ * process dispatched on it is held back until the work is done, in whole
+ * clock units; the time is busy time and also counted as system time. The
+ * part of the last clock unit left over is credited to the next charge, so
+ * work much smaller than a clock unit is charged at its average. On an
+ * idle CPU the work waits for the next dispatch.
+ */
+void sim_engine_syscharge(int cpu, long long ns)
+{
+	sim_engine_cpus[cpu].sys_work += ns;
+}
+
+static int _sim_engine_speed(int cpu)
+{
+	return sim_engine_cpus[cpu].type.capacity * sim_engine_freqs[sim_engine_freq].speed;
+}
+
+static void _sim_engine_cpu_release(int cpu)
+{
+	sim_engine_cpus[cpu].curr = NULL;
+	sim_engine_cpus[cpu].idle_since = sim_engine_clock;
+}
+
+void sim_engine_set_coalesce(int window, int count, void (*callback_devioready_batch)(void **, int))
+{
+	sim_engine_irq_window = window;
+	sim_engine_irq_count = count;
+	sim_engine_callback_devioready_batch = callback_devioready_batch;
+}
+
+void sim_engine_irqstats(struct sim_engine_irqstats *stats)
+{
+	*stats = sim_engine_irq_stats;
+}
+
+/* Deliver every pending completion in one interrupt on CPU 0 */
+static void _sim_engine_irq_deliver(void)
+{
+	struct sim_engine_proc_cb *engine_proc_cb_p;
+	long long latency;
+	int i, n = 0;
+	SIM_PROF_BEGIN();
+
+	if (sim_engine_irq_batch_cap < sim_engine_irq_npending) {
+		sim_engine_irq_batch_cap = sim_engine_irq_npending * 2;
+		sim_engine_irq_batch = realloc(sim_engine_irq_batch, sim_engine_irq_batch_cap * sizeof(*sim_engine_irq_batch));
+	}
+	while ((engine_proc_cb_p = TAILQ_FIRST(&sim_engine_irqpend)) != NULL) {
+		TAILQ_REMOVE(&sim_engine_irqpend, engine_proc_cb_p, proc_list);
+		TAILQ_INSERT_TAIL(&sim_engine_active, engine_proc_cb_p, proc_list);
+		latency = sim_engine_clock - engine_proc_cb_p->ioready_clock;
+		sim_engine_irq_stats.latency += latency;
+		if (latency > sim_engine_irq_stats.max_latency)
+			sim_engine_irq_stats.max_latency = latency;
+		sim_engine_irq_batch[n++] = engine_proc_cb_p->proc_cb_p;
+	}
+	sim_engine_irq_npending = 0;
+	sim_engine_irq_stats.interrupts++;
+
+	sim_engine_curcpu = 0;
+	sim_engine_intr++;
+	if (sim_engine_callback_devioready_batch != NULL) {
+		sim_engine_callback_devioready_batch(sim_engine_irq_batch, n);
+	} else {
+		for (i = 0; i < n; i++)
+			sim_engine_callback_devioready(sim_engine_irq_batch[i]);
+	}
+	sim_engine_intr--;
+	SIM_PROF_END();
+}
+
+/* Advance the clock by dt, crediting every CPU that is in a burst */
+static void _sim_engine_advance(long long dt)
+{
+	struct sim_engine_proc_cb *engine_proc_cb_p;
+	int c;
+
+	for (c = 0; c < sim_engine_ncpus; c++) {
+		engine_proc_cb_p = sim_engine_cpus[c].curr;
+		if (engine_proc_cb_p == NULL)
+			continue;
+		if (sim_engine_cpus[c].sys_work > 0) {
+			/* the process waits; dt never goes past the end of the system work */
+			sim_engine_cpus[c].sys_work -= dt * _sim_engine_speed(c) * SIM_ENGINE_SYS_NS;
+			sim_engine_cpus[c].sys_time += dt;
+			_sim_engine_busy(c, dt);
+			continue;
+		}
+		engine_proc_cb_p->rem -= (long long)dt * _sim_engine_speed(c);
+		if (engine_proc_cb_p->rem < 0)
+			engine_proc_cb_p->rem = 0;
+		if (engine_proc_cb_p->cpu_sliced)
+			engine_proc_cb_p->cpu_maxburst -= dt;
+		_sim_engine_busy(c, dt);
+	}
+	sim_engine_clock += dt;
+}
+
+/*
+ * Run the simulation until self may run its own code again: it is
+ * dispatched on a CPU and not in a burst. With self == NULL (a thread that
+ * is not a process, or one that is exiting) return as soon as the baton
+ * has been handed to a process. Also returns if no event is left.
+ */
+static void _sim_engine_run(struct sim_engine_proc_cb *self)
+{
+	SIM_PROF_BEGIN();
+
+	for (;;) {
+		struct sim_engine_proc_cb *engine_proc_cb_p, *nextioready;
+		long long t, when = 0;
+		int c, ev = -1, evcpu = 0;
+
+		if (self != NULL && self->cpu >= 0 && self->rem == 0 && sim_engine_cpus[self->cpu].sys_work <= 0) {
+			sim_engine_curcpu = self->cpu;
+			SIM_PROF_END();
+			return;
+		}
+
+		/* a process dispatched outside of a burst runs first, in zero time */
+		for (c = 0; c < sim_engine_ncpus; c++) {
+			engine_proc_cb_p = sim_engine_cpus[c].curr;
+			if (engine_proc_cb_p != NULL && engine_proc_cb_p->rem == 0 && sim_engine_cpus[c].sys_work <= 0)
+				break;
+		}
+		if (c < sim_engine_ncpus) {
+			sim_engine_curcpu = c;
+			SIM_PROF_PARK();
+			sem_post(&engine_proc_cb_p->cpusem);
+			if (self == NULL) {
+				SIM_PROF_END();
+				return;
+			}
+			sem_wait(&self->cpusem);
+			SIM_PROF_UNPARK();
+			continue;
+		}
+
+		/* earliest event; ties go to the lower event type, then the lower CPU */
+		for (c = 0; c < sim_engine_ncpus; c++) {
+			int speed = _sim_engine_speed(c);
+
+			engine_proc_cb_p = sim_engine_cpus[c].curr;
+			if (engine_proc_cb_p == NULL)
+				continue;
+			/* system work comes first; its end is handled like a burst end */
+			if (sim_engine_cpus[c].sys_work > 0) {
+				t = (sim_engine_cpus[c].sys_work + speed * SIM_ENGINE_SYS_NS - 1) / (speed * SIM_ENGINE_SYS_NS);
+				if (ev < 0 || t < when || (t == when && ev > SIM_EV_BURST)) {
+					ev = SIM_EV_BURST;
+					when = t;
+					evcpu = c;
+				}
+				continue;
+			}
+			t = (engine_proc_cb_p->rem + speed - 1) / speed;
+			if (ev < 0 || t < when || (t == when && ev > SIM_EV_BURST)) {
+				ev = SIM_EV_BURST;
+				when = t;
+				evcpu = c;
+			}
+			/* a burst that ends exactly with the slice is not cut short */
+			if (engine_proc_cb_p->cpu_sliced && engine_proc_cb_p->cpu_maxburst < t) {
+				t = engine_proc_cb_p->cpu_maxburst;
+				if (t < when || (t == when && ev > SIM_EV_SLICE)) {
+					ev = SIM_EV_SLICE;
+					when = t;
+					evcpu = c;
+				}
+			}
+		}
+		nextioready = TAILQ_FIRST(&sim_engine_iowait);
+		if (nextioready != NULL) {
+			t = nextioready->ioready_clock - sim_engine_clock;
+			if (ev < 0 || t < when) {
+				ev = SIM_EV_IO;
+				when = t;
+			}
+		}
+		if (sim_engine_irq_npending > 0) {
+			t = sim_engine_irq_deadline - sim_engine_clock;
+			if (ev < 0 || t < when) {
+				ev = SIM_EV_IRQ;
+				when = t;
+			}
+		}
+		if (ev < 0) {
+			SIM_PROF_END();
+			return;
+		}
+		if (sim_engine_governor >= SIM_GOV_ONDEMAND) {
+			if (sim_engine_fastforward)
+				_sim_engine_governor_skip(when);
+			t = sim_engine_gov_next > sim_engine_clock ? sim_engine_gov_next - sim_engine_clock : 0;
+			if (t < when) {
+				ev = SIM_EV_GOV;
+				when = t;
+			}
+		}
+
+		_sim_engine_advance(when);
+		SIM_PROF_TICK(sim_engine_clock);
+
+		switch (ev) {
+		case SIM_EV_SLICE:
+			/* process cpu runout */
+			engine_proc_cb_p = sim_engine_cpus[evcpu].curr;
+			engine_proc_cb_p->cpu_maxburst = 0;
+			sim_engine_curcpu = evcpu;
+			sim_engine_intr++;
+			sim_engine_callback_cpurunout(engine_proc_cb_p->proc_cb_p);
+			sim_engine_intr--;
+			break;
+		case SIM_EV_IO:
+			TAILQ_REMOVE(&sim_engine_iowait, nextioready, proc_list);
+			if (nextioready->iodevice)
+				sim_engine_irq_stats.completions++;
+			if (sim_engine_irq_window >= 0 && nextioready->iodevice) {
+				TAILQ_INSERT_TAIL(&sim_engine_irqpend, nextioready, proc_list);
+				if (sim_engine_irq_npending++ == 0)
+					sim_engine_irq_deadline = sim_engine_clock + sim_engine_irq_window;
+				if (sim_engine_irq_count > 0 && sim_engine_irq_npending >= sim_engine_irq_count)
+					_sim_engine_irq_deliver();
+				break;
+			}
+			if (nextioready->iodevice)
+				sim_engine_irq_stats.interrupts++;
+			TAILQ_INSERT_TAIL(&sim_engine_active, nextioready, proc_list);
+
+			/* call iointr; device interrupts are delivered to CPU 0 */
+			sim_engine_curcpu = 0;
+			sim_engine_intr++;
+			sim_engine_callback_devioready(nextioready->proc_cb_p);
+			sim_engine_intr--;
+			break;
+		case SIM_EV_IRQ:
+			_sim_engine_irq_deliver();
+			break;
+		case SIM_EV_GOV:
+			_sim_engine_governor_sample();
+			break;
+		default:
+			/* burst end: the process runs on at the top of the loop */
+			break;
+		}
+	}
+}
+
 void *_sim_loadproc2(void *_engine_proc_cb_p)
 {
 	struct sim_engine_proc_cb *engine_proc_cb_p = _engine_proc_cb_p;
 	void *proc_cb_p = engine_proc_cb_p->proc_cb_p;
 
 	pthread_setspecific(sim_engine_tkey_proc_cb, engine_proc_cb_p);
-	TAILQ_INSERT_TAIL(&sim_engine_active, engine_proc_cb_p, proc_list);
 
 	sem_wait(&engine_proc_cb_p->cpusem);
+	SIM_PROF_UNPARK();
 
 	engine_proc_cb_p->proc_func();
 
+	/* from here on the thread is no longer a process */
+	pthread_setspecific(sim_engine_tkey_proc_cb, NULL);
 	TAILQ_REMOVE(&sim_engine_active, engine_proc_cb_p, proc_list);
+	if (engine_proc_cb_p->cpu >= 0) {
+		sim_engine_curcpu = engine_proc_cb_p->cpu;
+		_sim_engine_cpu_release(engine_proc_cb_p->cpu);
+	}
 	sem_destroy(&engine_proc_cb_p->cpusem);
 	free(engine_proc_cb_p);
 
 	sim_engine_procs_count--;
-	if(sim_engine_procs_count < 1)
-		sem_post(&sim_engine_running);
 
 	sim_engine_callback_exit(proc_cb_p);
 
+	/* post only after the exit callback so its output precedes the caller's */
+	if(sim_engine_procs_count < 1) {
+		SIM_PROF_PARK();
+		sem_post(&sim_engine_running);
+	} else
+		_sim_engine_run(NULL);
+
 	return NULL;
 }
 
 int sim_loadproc(void (*func)(void), struct sim_cpustate *sim_cpustate_p, void *proc_cb_p)
 {
 	struct sim_engine_proc_cb *engine_proc_cb_p = malloc(sizeof(*engine_proc_cb_p));
+	SIM_PROF_BEGIN();
 
 	engine_proc_cb_p->proc_cb_p = proc_cb_p;
 	engine_proc_cb_p->proc_func = func;
+	engine_proc_cb_p->cpu = -1;
+	engine_proc_cb_p->rem = 0;
 	sem_init(&engine_proc_cb_p->cpusem, 0, 0);
 
 	sim_cpustate_p->cpustate_uptodate = true;
@@ -88,79 +699,105 @@ int sim_loadproc(void (*func)(void), struct sim_cpustate *sim_cpustate_p, void *
 
 	sem_trywait(&sim_engine_running);
 	sim_engine_procs_count++;
+	TAILQ_INSERT_TAIL(&sim_engine_active, engine_proc_cb_p, proc_list);
 
 	pthread_create(&engine_proc_cb_p->tid, NULL, _sim_loadproc2, engine_proc_cb_p);
 
+	SIM_PROF_END();
 	return 1;
 }
 
 
+/* Take a process off its CPU; a burst in progress is kept for the next restore */
 void sim_cpustate_save(struct sim_cpustate *sim_cpustate_p)
 {
-	struct sim_engine_proc_cb *engine_proc_cb_p = pthread_getspecific(sim_engine_tkey_proc_cb);
+	struct sim_engine_proc_cb *engine_proc_cb_p = sim_cpustate_p->state_info_dummy;
+	SIM_PROF_BEGIN();
 
 	sim_cpustate_p->cpustate_uptodate = true;
-	sim_cpustate_p->state_info_dummy = engine_proc_cb_p;
 	engine_proc_cb_p->cpustate_p = sim_cpustate_p;
+	if (engine_proc_cb_p->cpu >= 0 && sim_engine_cpus[engine_proc_cb_p->cpu].curr == engine_proc_cb_p)
+		_sim_engine_cpu_release(engine_proc_cb_p->cpu);
+	engine_proc_cb_p->cpu = -1;
+	SIM_PROF_END();
 }
 
-void sim_cpustate_restore(struct sim_cpustate *sim_cpustate_p, int cpu_maxburst)
+/*
+ * Dispatch a process on a CPU and return at once, even when called by a
+ * process: e.g. to start the siblings of a thread on other CPUs before
+ * the caller picks what runs on its own CPU.
+ */
+int sim_cpustate_dispatch(struct sim_cpustate *sim_cpustate_p, int cpu, long long cpu_maxburst)
 {
-	struct sim_engine_proc_cb *engine_proc_cb_p = pthread_getspecific(sim_engine_tkey_proc_cb);
+	struct sim_engine_proc_cb *target = sim_cpustate_p->state_info_dummy;
+	struct sim_engine_cpu *c = &sim_engine_cpus[cpu];
 
-	if (!sim_cpustate_p->cpustate_uptodate || sim_cpustate_p != ((struct sim_engine_proc_cb *)(sim_cpustate_p->state_info_dummy))->cpustate_p) {
+	if (!sim_cpustate_p->cpustate_uptodate || sim_cpustate_p != target->cpustate_p) {
 		/* error */
-		return;
+		return 0;
 	}
 	sim_cpustate_p->cpustate_uptodate = false;
-	((struct sim_engine_proc_cb *)(sim_cpustate_p->state_info_dummy))->cpu_maxburst = cpu_maxburst;
-	sem_post(&((struct sim_engine_proc_cb *)(sim_cpustate_p->state_info_dummy))->cpusem);
-	if (engine_proc_cb_p != NULL) {
-		sem_wait(&engine_proc_cb_p->cpusem);
-	}
+	target->cpu_maxburst = cpu_maxburst;
+	target->cpu_sliced = cpu_maxburst > 0;
+
+	if (c->curr == NULL)
+		_sim_engine_idle(&sim_engine_energy_acct, cpu, sim_engine_clock - c->idle_since);
+	else if (c->curr != target)
+		c->curr->cpu = -1;
+	c->curr = target;
+	target->cpu = cpu;
+
+	return 1;
 }
 
-void sim_cpuburst(int wait)
+/*
+ * Dispatch a process on a CPU. Called by a process, the caller then waits
+ * until it is dispatched again itself; called from a callback it returns
+ * at once and the process runs when the callback is done.
+ */
+void sim_cpustate_restore_cpu(struct sim_cpustate *sim_cpustate_p, int cpu, long long cpu_maxburst)
 {
 	struct sim_engine_proc_cb *engine_proc_cb_p = pthread_getspecific(sim_engine_tkey_proc_cb);
 
-	while (wait > 0) {
-		struct sim_engine_proc_cb *nextioready = TAILQ_FIRST(&sim_engine_iowait);
-		if (nextioready != NULL && nextioready->ioready_clock < ((engine_proc_cb_p->cpu_maxburst == 0 || wait < engine_proc_cb_p->cpu_maxburst) ? wait : engine_proc_cb_p->cpu_maxburst) + sim_engine_clock) {
-			wait -= nextioready->ioready_clock - sim_engine_clock;
-			if (engine_proc_cb_p->cpu_maxburst > 0)
-				engine_proc_cb_p->cpu_maxburst -= nextioready->ioready_clock - sim_engine_clock;
-			sim_engine_clock = nextioready->ioready_clock;
+	if (!sim_cpustate_dispatch(sim_cpustate_p, cpu, cpu_maxburst))
+		return;
+	SIM_PROF_BEGIN();
+	if (engine_proc_cb_p != NULL && sim_engine_intr == 0)
+		_sim_engine_run(engine_proc_cb_p);
+	SIM_PROF_END();
+}
 
-			TAILQ_REMOVE(&sim_engine_iowait, nextioready, proc_list);
-			TAILQ_INSERT_TAIL(&sim_engine_active, nextioready, proc_list);
+void sim_cpustate_restore(struct sim_cpustate *sim_cpustate_p, long long cpu_maxburst)
+{
+	sim_cpustate_restore_cpu(sim_cpustate_p, sim_engine_curcpu, cpu_maxburst);
+}
 
-			/* call iointr */
-			sim_engine_callback_devioready(nextioready->proc_cb_p);
+/* Change the remaining time slice of a process that is currently running */
+void sim_cpustate_setmaxburst(struct sim_cpustate *sim_cpustate_p, long long cpu_maxburst)
+{
+	struct sim_engine_proc_cb *engine_proc_cb_p = sim_cpustate_p->state_info_dummy;
 
-			continue;
-		}
+	engine_proc_cb_p->cpu_maxburst = cpu_maxburst;
+	engine_proc_cb_p->cpu_sliced = true;
+}
 
-		if (engine_proc_cb_p->cpu_maxburst > 0 && wait > engine_proc_cb_p->cpu_maxburst) {
-			/* process cpu runout */
-			sim_engine_clock += engine_proc_cb_p->cpu_maxburst;
-			wait -= engine_proc_cb_p->cpu_maxburst;
-			engine_proc_cb_p->cpu_maxburst = 0;
+/*
+ * Run for an amount of work: work * 100 / s clock units at speed s (percent
+ * of a big core at the top frequency). Other CPUs and devices make progress
+ * meanwhile; their events are handled on this thread.
+ */
+void sim_cpuburst(long long work)
+{
+	struct sim_engine_proc_cb *engine_proc_cb_p = pthread_getspecific(sim_engine_tkey_proc_cb);
+	SIM_PROF_BEGIN();
 
-			/* call cpurunout intr */
-			sim_engine_callback_cpurunout(engine_proc_cb_p->proc_cb_p);
-		} else {
-			sim_engine_clock += wait;
-			if (engine_proc_cb_p->cpu_maxburst > 0)
-				engine_proc_cb_p->cpu_maxburst -= wait;
-			wait = 0;
-		}
-	}
+	engine_proc_cb_p->rem = work > 0 ? work * SIM_ENGINE_WORK_SCALE : 0;
+	_sim_engine_run(engine_proc_cb_p);
+	SIM_PROF_END();
 }
 
-void sim_deviorequest(int wait)
+static void _sim_engine_iowait(struct sim_engine_proc_cb *engine_proc_cb_p, long long wait)
 {
-	struct sim_engine_proc_cb *engine_proc_cb_p = pthread_getspecific(sim_engine_tkey_proc_cb);
 	struct sim_engine_proc_cb *ent;
 
 	TAILQ_REMOVE(&sim_engine_active, engine_proc_cb_p, proc_list);
@@ -178,29 +815,56 @@ void sim_deviorequest(int wait)
 		TAILQ_INSERT_TAIL(&sim_engine_iowait, engine_proc_cb_p, proc_list);
 }
 
-void sim_wait_nextintr(void)
+void sim_deviorequest(long long wait)
 {
 	struct sim_engine_proc_cb *engine_proc_cb_p = pthread_getspecific(sim_engine_tkey_proc_cb);
-	struct sim_engine_proc_cb *nextioready = TAILQ_FIRST(&sim_engine_iowait);
+	SIM_PROF_BEGIN();
 
-	if (nextioready == NULL)
-		return;
+	engine_proc_cb_p->iodevice = true;
+	_sim_engine_iowait(engine_proc_cb_p, wait);
+	SIM_PROF_END();
+}
+
+/*
+ * Delay a process that is not dispatched (e.g. a job still travelling
+ * over the network): it is reported through the devioready callback
+ * after wait, like a completed I/O request.
+ */
+void sim_cpustate_sleep(struct sim_cpustate *sim_cpustate_p, long long wait)
+{
+	struct sim_engine_proc_cb *engine_proc_cb_p = sim_cpustate_p->state_info_dummy;
 
-	sim_engine_clock = nextioready->ioready_clock;
+	if (engine_proc_cb_p->cpu >= 0)
+		return;
+	SIM_PROF_BEGIN();
+	engine_proc_cb_p->iodevice = false;
+	_sim_engine_iowait(engine_proc_cb_p, wait);
+	SIM_PROF_END();
+}
 
-	TAILQ_REMOVE(&sim_engine_iowait, nextioready, proc_list);
-	TAILQ_INSERT_TAIL(&sim_engine_active, nextioready, proc_list);
+/*
+ * Called by a process that has given up its CPU: wait until it is
+ * dispatched again. In a callback the CPU simply stays idle.
+ */
+void sim_wait_nextintr(void)
+{
+	struct sim_engine_proc_cb *engine_proc_cb_p = pthread_getspecific(sim_engine_tkey_proc_cb);
 
-	/* call iointr */
-	sim_engine_callback_devioready(nextioready->proc_cb_p);
+	if (engine_proc_cb_p == NULL || sim_engine_intr > 0)
+		return;
+	SIM_PROF_BEGIN();
+	_sim_engine_run(engine_proc_cb_p);
+	SIM_PROF_END();
 }
 
-int sim_engine_getclock(void)
+long long sim_engine_getclock(void)
 {
 	return sim_engine_clock;
 }
 
 void sim_engine_wait_allfinish(void)
 {
+	_sim_engine_run(NULL);
 	sem_wait(&sim_engine_running);
+	SIM_PROF_UNPARK();
 }
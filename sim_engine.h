@@ -1,5 +1,67 @@
+#ifndef SIM_ENGINE_H
+#define SIM_ENGINE_H
+
 #include <stdbool.h>
 
+#define SIM_ENGINE_NFREQ 4
+#define SIM_ENGINE_NIDLE 3
+
+/* CPU frequency level: speed in percent of the top level, active power in mW */
+struct sim_engine_freq {
+	int speed;
+	int power;
+};
+
+/* Idle state: entered when the idle period is at least residency */
+struct sim_engine_idlestate {
+	const char *name;
+	int residency;
+	int power;
+};
+
+enum sim_engine_governor {
+	SIM_GOV_PERFORMANCE = 0,
+	SIM_GOV_POWERSAVE,
+	SIM_GOV_USERSPACE,	/* the scheduler sets the level with sim_engine_setfreq() */
+	SIM_GOV_ONDEMAND,
+	SIM_GOV_SCHEDUTIL
+};
+
+struct sim_engine_energy {
+	long long busy_time[SIM_ENGINE_NFREQ];
+	long long idle_time[SIM_ENGINE_NIDLE];
+	double busy_joules;
+	double idle_joules;
+	int transitions;
+};
+
+extern const struct sim_engine_freq sim_engine_freqs[SIM_ENGINE_NFREQ];
+extern const struct sim_engine_idlestate sim_engine_idlestates[SIM_ENGINE_NIDLE];
+
+#define SIM_ENGINE_MAXCPUS 64
+
+/*
+ * Core type: capacity is the speed in percent of the fastest core type,
+ * power scales the active and idle power of the tables above (percent).
+ * All cores share one frequency domain.
+ */
+struct sim_engine_cputype {
+	const char *name;
+	int capacity;
+	int power;
+};
+
+extern const struct sim_engine_cputype sim_engine_cpu_big;
+extern const struct sim_engine_cputype sim_engine_cpu_little;
+
+/* I/O completion interrupts, see sim_engine_set_coalesce() */
+struct sim_engine_irqstats {
+	int interrupts;
+	int completions;
+	long long latency;	/* total delay added by coalescing */
+	long long max_latency;
+};
+
 
 
 struct sim_cpustate {
@@ -10,9 +72,31 @@ struct sim_cpustate {
 extern int sim_engine_init(void (*callback_devioready)(void *), void (*callback_cpurunout)(void *), void (*callback_exit)(void *));
 extern int sim_loadproc(void (*func)(void), struct sim_cpustate *sim_cpustate_p, void *proc_cb_p);
 extern void sim_cpustate_save(struct sim_cpustate *sim_cpustate_p);
-extern void sim_cpustate_restore(struct sim_cpustate *sim_cpustate_p, int cpu_maxburst);
-extern void sim_cpuburst(int time);
-extern void sim_deviorequest(int time);
+extern void sim_cpustate_restore(struct sim_cpustate *sim_cpustate_p, long long cpu_maxburst);
+extern int sim_cpustate_dispatch(struct sim_cpustate *sim_cpustate_p, int cpu, long long cpu_maxburst);
+extern void sim_cpustate_restore_cpu(struct sim_cpustate *sim_cpustate_p, int cpu, long long cpu_maxburst);
+extern void sim_cpustate_setmaxburst(struct sim_cpustate *sim_cpustate_p, long long cpu_maxburst);
+extern void sim_cpustate_sleep(struct sim_cpustate *sim_cpustate_p, long long wait);
+extern void sim_cpuburst(long long time);
+extern void sim_deviorequest(long long time);
 extern void sim_wait_nextintr(void);
-extern int sim_engine_getclock(void);
+extern long long sim_engine_getclock(void);
+extern int sim_engine_setcpus(int ncpus, const struct sim_engine_cputype *types);
+extern int sim_engine_getncpus(void);
+extern int sim_engine_getcpu(void);
+extern const struct sim_engine_cputype *sim_engine_cputype(int cpu);
+extern long long sim_engine_cpu_busytime(int cpu);
+extern long long sim_engine_cpu_systime(int cpu);
+extern void sim_engine_syscharge(int cpu, long long ns);
 extern void sim_engine_wait_allfinish(void);
+extern void sim_engine_set_governor(enum sim_engine_governor governor);
+extern void sim_engine_setfreq(int level);
+extern int sim_engine_getfreq(void);
+extern int sim_engine_freq_efficient(void);
+extern void sim_engine_energy(struct sim_engine_energy *energy);
+extern void sim_engine_set_coalesce(int window, int count, void (*callback_devioready_batch)(void **, int));
+extern void sim_engine_irqstats(struct sim_engine_irqstats *stats);
+extern void sim_engine_set_fastforward(bool on);
+extern long long sim_engine_fastforward_skipped(void);
+
+#endif
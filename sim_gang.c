@@ -0,0 +1,364 @@
+// 文件名: sim_gang.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sim_gang.h"
+#include "sim_compare.h"
+
+/* gang: 每个 CPU 在当前时间片内保留给哪个线程组 */
+struct sim_thread_group *cpu_gang[SIM_ENGINE_MAXCPUS];
+/* 所有线程组的屏障等待，以及 CPU 碎片: 节点里有就绪的进程在等，却有 CPU 空着 */
+int barrier_waits = 0;
+long long barrier_wait_total = 0, barrier_wait_max = 0;
+long long frag_area = 0;     // 空着的 CPU 数 (不超过在等的进程数) 对时间的积分
+long long reserved_area = 0; // gang: 保留给线程组却空着的 CPU 数对时间的积分
+long long frag_since = 0;
+
+/* 把到 clock 为止的 CPU 碎片计入积分；CPU 和就绪进程数在两个时刻之间不变 */
+void sim_frag_integrate(long long clock) {
+    int n, c, idle, reserved, ready;
+
+    if (clock <= frag_since)
+        return;
+    for (n = 0; n < nr_nodes; n++) {
+        idle = reserved = 0;
+        for (c = n * cpus_per_node; c < (n + 1) * cpus_per_node; c++) {
+            if (cpu_curr[c] != NULL)
+                continue;
+            idle++;
+            if (cpu_gang[c] != NULL)
+                reserved++;
+        }
+        ready = node_load[n] - (cpus_per_node - idle);
+        if (ready > 0)
+            frag_area += (long long)(idle < ready ? idle : ready) * (clock - frag_since);
+        reserved_area += (long long)reserved * (clock - frag_since);
+    }
+    frag_since = clock;
+}
+
+/*
+ * gang 调度 (-P gang): 一个多线程进程的所有线程在同一时刻各占一个 CPU，
+ * 一起开始、在时间片结束时一起被抢占。调度时为线程组保留与线程数相同的
+ * CPU (Ousterhout 矩阵的一列)，时间片内这些 CPU 只运行本组的线程；线程在
+ * I/O 或屏障上阻塞时 CPU 空着，这就是 gang 调度的碎片。单线程进程占一个
+ * 没有保留的 CPU。
+ */
+int sim_gang_select_cpu(struct sim_proc *proc_p) {
+    int lo = proc_p->proc_node * cpus_per_node, hi = lo + cpus_per_node;
+    int c;
+
+    for (c = lo; c < hi; c++) {
+        if (proc_p->group != NULL && cpu_gang[c] == proc_p->group && cpu_curr[c] == NULL)
+            return c;
+    }
+    for (c = lo; c < hi; c++) {
+        if (cpu_gang[c] == NULL && cpu_curr[c] == NULL)
+            return c;
+    }
+    for (c = lo; c < hi; c++) {
+        if (cpu_curr[c] != NULL)
+            return c; // 没有空闲的 CPU: 等某个 CPU 重新调度时再排进去
+    }
+    return lo;
+}
+
+/* 时间片结束: 收回为线程组保留的 CPU */
+void sim_gang_release(struct sim_thread_group *g) {
+    int c;
+
+    for (c = 0; c < nr_cpus; c++) {
+        if (cpu_gang[c] == g)
+            cpu_gang[c] = NULL;
+    }
+    g->nr_cpus = 0;
+}
+
+/* 既没有进程在运行、也没有保留给线程组的 CPU；taken 是已经排了进程、还没分派的 CPU */
+bool sim_gang_cpufree(int c, int taken) {
+    return cpu_curr[c] == NULL && cpu_gang[c] == NULL && c != taken;
+}
+
+/*
+ * 按就绪队列的顺序把放得下的进程排进本节点空闲的 CPU (first fit)，线程组
+ * 要一次拿到 nr_live 个 CPU。排到 cpu 上的进程返回给调用者分派，其余的直接
+ * 在各自的 CPU 上分派。
+ */
+struct sim_proc *sim_gang_fill(int cpu, int *examined) {
+    int node = cpu / cpus_per_node, lo = node * cpus_per_node, hi = lo + cpus_per_node;
+    struct sim_proc *p, *mine = NULL;
+    struct sim_thread_group *g;
+    int c, nfree, width, taken = -1;
+    char log_msg[100];
+
+    for (;;) {
+        nfree = 0;
+        for (c = lo; c < hi; c++)
+            nfree += sim_gang_cpufree(c, taken);
+        if (nfree == 0)
+            break;
+        TAILQ_FOREACH(p, &ready_queue, proc_list) {
+            (*examined)++;
+            if (p == mine || p->proc_node != node || (p->group != NULL && p->group->nr_cpus > 0))
+                continue;
+            width = p->group != NULL ? p->group->nr_live : 1;
+            if (width <= nfree)
+                break;
+        }
+        if (p == NULL)
+            break;
+
+        g = p->group;
+        if (g == NULL) {
+            for (c = sim_gang_cpufree(cpu, taken) ? cpu : lo; !sim_gang_cpufree(c, taken); c++)
+                ;
+            if (c == cpu) {
+                mine = p;
+                taken = cpu;
+            } else {
+                sim_dispatch_other(p, c);
+            }
+            continue;
+        }
+
+        /* 先保留全部 CPU (尽量包括 cpu)，再把就绪的线程逐个放上去 */
+        g->nr_cpus = width;
+        g->slot_end = sim_engine_getclock() + SIM_CPUMAXBURST;
+        if (sim_gang_cpufree(cpu, taken)) {
+            cpu_gang[cpu] = g;
+            width--;
+        }
+        for (c = lo; width > 0; c++) {
+            if (sim_gang_cpufree(c, taken)) {
+                cpu_gang[c] = g;
+                width--;
+            }
+        }
+        sprintf(log_msg, "[Trace] Gang %s scheduled on %d CPU(s) until %lld.%03lld",
+            g->name, g->nr_cpus, g->slot_end / 1000, g->slot_end % 1000);
+        sim_logging(NULL, log_msg);
+        for (c = lo; c < hi; c++) {
+            if (cpu_gang[c] != g || cpu_curr[c] != NULL || c == taken)
+                continue;
+            TAILQ_FOREACH(p, &ready_queue, proc_list) {
+                if (p->group == g && p != mine)
+                    break;
+            }
+            if (p == NULL)
+                break; // 其余线程在阻塞，保留的 CPU 空着等它们
+            if (c == cpu) {
+                mine = p;
+                taken = cpu;
+            } else {
+                sim_dispatch_other(p, c);
+            }
+        }
+    }
+    return mine;
+}
+
+struct sim_proc *sim_gang_pick(int cpu, int *examined) {
+    struct sim_thread_group *g = cpu_gang[cpu];
+    struct sim_proc *p;
+
+    if (g != NULL) {
+        if (sim_engine_getclock() < g->slot_end && g->nr_running + g->nr_ready > 0) {
+            TAILQ_FOREACH(p, &ready_queue, proc_list) {
+                (*examined)++;
+                if (p->group == g)
+                    return p;
+            }
+            return NULL; // 保留给本组，空着等它的线程
+        }
+        /* 本组其余线程的时间片在同一时刻到期，等它们都让出 CPU 再一起重新分配 */
+        if (g->nr_running > 0)
+            return NULL;
+        sim_gang_release(g);
+    }
+    return sim_gang_fill(cpu, examined);
+}
+
+/*
+ * 协同调度 (-P cosched): 不保留 CPU，只是尽量让线程一起运行。优先选兄弟
+ * 线程正在运行的线程；一个线程开始运行时，把它就绪的兄弟线程拉到本节点
+ * 空闲的 CPU 上。
+ */
+struct sim_proc *sim_cosched_pick(int cpu, int *examined) {
+    int node = cpu / cpus_per_node;
+    struct sim_proc *p;
+
+    TAILQ_FOREACH(p, &ready_queue, proc_list) {
+        (*examined)++;
+        if (p->proc_node == node && p->group != NULL && p->group->nr_running > 0)
+            return p;
+    }
+    return NULL;
+}
+
+void sim_cosched_pull(struct sim_thread_group *g, int cpu) {
+    int node = cpu / cpus_per_node, lo = node * cpus_per_node, hi = lo + cpus_per_node;
+    struct sim_proc *p;
+    int c;
+
+    for (c = lo; c < hi; c++) {
+        if (cpu_curr[c] != NULL)
+            continue;
+        TAILQ_FOREACH(p, &ready_queue, proc_list) {
+            if (p->group == g && p->proc_node == node)
+                break;
+        }
+        sim_cost_count(0, nr_ready);
+        if (p == NULL)
+            return;
+        sim_dispatch_other(p, c);
+    }
+}
+
+/* --- 多线程进程: 线程组和屏障 --- */
+
+/* 创建一个有 n 个线程的进程，线程都运行 func；返回共享的 pid */
+int sim_createthreads(void (*func)(void), int priority, int n) {
+    struct sim_thread_group *g = calloc(1, sizeof(*g));
+    struct sim_proc *proc_p;
+    char log_msg[100];
+    int i;
+
+    if (g == NULL)
+        return 0;
+    g->first_run = -1;
+    g->creation_time = sim_engine_getclock();
+    TAILQ_INIT(&g->barrier.waiters);
+    for (i = 0; i < n; i++) {
+        proc_p = sim_allocproc(func, priority, g);
+        if (proc_p == NULL)
+            break;
+        if (i == 0) {
+            sprintf(g->name, "Process#%d", g->pid);
+            g->barrier.name = g->name;
+        }
+        sim_proc_setstate(proc_p, READY);
+        TAILQ_INSERT_TAIL(&ready_queue, proc_p, proc_list);
+        proc_p->proc_cpu = sim_select_cpu(proc_p);
+
+        sprintf(log_msg, "Created as state READY with priority %d (thread %d of %d)", priority, i + 1, n);
+        sim_logging(proc_p, log_msg);
+    }
+    if (g->nr_threads == 0) {
+        free(g);
+        return 0;
+    }
+    return g->pid;
+}
+
+/* 放行屏障上所有等待的线程，记录它们的等待时间 */
+void sim_barrier_release(struct sim_thread_group *g) {
+    struct sim_barrier *b = &g->barrier;
+    struct sim_proc *w;
+    long long waited;
+
+    b->arrived = 0;
+    while ((w = TAILQ_FIRST(&b->waiters)) != NULL) {
+        waited = sim_engine_getclock() - w->wait_since;
+        g->barrier_waits++;
+        g->barrier_wait_total += waited;
+        if (waited > g->barrier_wait_max)
+            g->barrier_wait_max = waited;
+        barrier_waits++;
+        barrier_wait_total += waited;
+        if (waited > barrier_wait_max)
+            barrier_wait_max = waited;
+        sim_sync_wakeup(&b->waiters, w, "barrier", b->name);
+    }
+}
+
+/* 等本进程还没退出的线程都到达屏障；最后一个到达的线程不阻塞 */
+void sim_thread_barrier(void) {
+    struct sim_thread_group *g = activeproc->group;
+
+    if (g == NULL)
+        return;
+    if (++g->barrier.arrived < g->nr_live) {
+        sim_sync_block(&g->barrier.waiters, "barrier", g->barrier.name);
+        return;
+    }
+    sim_barrier_release(g);
+}
+
+/* 线程退出 (procexit 中，已经是 NOEXIST): 最后一个线程退出时进程才结束 */
+void sim_thread_exit(struct sim_proc *proc_p) {
+    struct sim_thread_group *g = proc_p->group;
+    long long turnaround = sim_engine_getclock() - g->creation_time;
+    char log_msg[160];
+    int s;
+
+    for (s = 0; s <= LOCKWAIT; s++)
+        g->state_time[s] += proc_p->state_time[s];
+    g->nr_dispatch += proc_p->nr_dispatch;
+    if (--g->nr_live > 0) {
+        proc_p->group = NULL;
+        /* 其余线程可能都在屏障上等这个线程 */
+        if (g->barrier.arrived > 0 && g->barrier.arrived >= g->nr_live)
+            sim_barrier_release(g);
+        return;
+    }
+
+    sprintf(log_msg, "[Stats] %s: %d threads, turnaround %lld.%03llds, %d barrier waits avg %lld max %lld total %lld",
+        g->name, g->nr_threads, turnaround / 1000, turnaround % 1000, g->barrier_waits,
+        g->barrier_waits > 0 ? g->barrier_wait_total / g->barrier_waits : 0LL, g->barrier_wait_max, g->barrier_wait_total);
+    sim_logging(NULL, log_msg);
+    if (compare_out != NULL)
+        sim_compare_record(proc_p);
+    sim_gang_release(g);
+    proc_p->group = NULL;
+    free(g);
+}
+
+/*
+ * 多线程进程的一个线程: CPU 阶段之间在屏障上同步，每三个阶段做一次 I/O。
+ * 一个阶段的时间取决于最慢的线程，线程不能同时运行时其余线程只能在屏障上等。
+ */
+#define THREAD_PHASES 6
+
+void sim_proc_thread(void) {
+    int i;
+
+    sim_logging(activeproc, "[App] Thread: Starting");
+    for (i = 0; i < THREAD_PHASES; i++) {
+        sim_cpuburst(sim_rand_burst(sim_rand_lognormal(&activeproc->proc_rand, log(40), 0.5)));
+        if (i % 3 == 2)
+            sim_iorequest(sim_rand_range(&activeproc->proc_rand, 10, 30));
+        sim_thread_barrier();
+    }
+    sim_logging(activeproc, "[App] Thread: Finished");
+}
+
+/* 多线程 workload (-w threads): nr_thread_procs 个各有 nr_threads 个线程的进程，加上单线程的背景负载 */
+int nr_thread_procs = 3;
+int nr_threads = 3;
+
+void sim_workload_threads(void) {
+    int i;
+
+    for (i = 0; i < nr_thread_procs; i++)
+        sim_createthreads(sim_proc_thread, PRIORITY_NORMAL, nr_threads);
+    sim_createproc(sim_proc_cpubound, PRIORITY_LOW);
+    sim_createproc(sim_proc_iobound, PRIORITY_NORMAL);
+}
+
+/* 屏障等待和 CPU 碎片 (-w threads，或者 gang/cosched 策略) */
+void sim_gang_report(void) {
+    long long clock = sim_engine_getclock();
+    double cpu_time = (double)clock * nr_cpus;
+    char log_msg[200];
+
+    sim_frag_integrate(clock);
+    sprintf(log_msg, "[Stats] barrier: %d waits, wait avg %lld max %lld total %lld",
+        barrier_waits, barrier_waits > 0 ? barrier_wait_total / barrier_waits : 0LL, barrier_wait_max, barrier_wait_total);
+    sim_logging(NULL, log_msg);
+    sprintf(log_msg, "[Stats] fragmentation: CPUs idle while processes ready %lld (%.1f%% of CPU time), reserved for gangs but idle %lld (%.1f%%)",
+        frag_area, cpu_time > 0 ? 100.0 * frag_area / cpu_time : 0.0,
+        reserved_area, cpu_time > 0 ? 100.0 * reserved_area / cpu_time : 0.0);
+    sim_logging(NULL, log_msg);
+}
+
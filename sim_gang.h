@@ -0,0 +1,63 @@
+// 文件名: sim_gang.h
+/*
+ * 多线程进程 (线程组和屏障) 以及让线程同时运行的 gang/cosched 调度，
+ * 和它们带来的屏障等待、CPU 碎片统计。
+ */
+#ifndef SIM_GANG_H
+#define SIM_GANG_H
+
+#include "sim_sched_advanced.h"
+
+/* 屏障: 线程组中还没退出的线程都到达后一起放行 */
+struct sim_barrier {
+    const char *name;
+    int arrived;
+    struct sim_waitq waiters;
+};
+
+/*
+ * 多线程进程 (-w threads): 线程共享 pid，各占一个 procs[] 槽位、各有自己的
+ * 引擎线程，在 CPU 阶段之间用屏障同步。
+ */
+struct sim_thread_group {
+    int pid;
+    int nr_threads;
+    int nr_live;    // 还没退出的线程数
+    int nr_ready;   // READY 的线程数
+    int nr_running; // RUNNING 的线程数
+    int nr_cpus;    // gang: 本时间片为它保留的 CPU 数，0 表示不在时间片内
+    long long slot_end; // gang: 本时间片结束的时刻
+    long long creation_time;
+    struct sim_barrier barrier;
+    char name[24];
+
+    /* statistics */
+    int barrier_waits;
+    long long barrier_wait_total, barrier_wait_max;
+    long long state_time[LOCKWAIT + 1]; // 已退出线程的状态时间之和
+    int nr_dispatch;
+    long long first_run;
+};
+
+extern struct sim_thread_group *cpu_gang[SIM_ENGINE_MAXCPUS];
+extern int barrier_waits;
+extern long long barrier_wait_total, barrier_wait_max;
+extern long long frag_area;
+extern long long reserved_area;
+
+/* -w threads 的进程数和每个进程的线程数 */
+extern int nr_thread_procs;
+extern int nr_threads;
+
+void sim_frag_integrate(long long clock);
+int sim_gang_select_cpu(struct sim_proc *proc_p);
+struct sim_proc *sim_gang_pick(int cpu, int *examined);
+struct sim_proc *sim_cosched_pick(int cpu, int *examined);
+void sim_cosched_pull(struct sim_thread_group *g, int cpu);
+int sim_createthreads(void (*func)(void), int priority, int n);
+void sim_thread_barrier(void);
+void sim_thread_exit(struct sim_proc *proc_p);
+void sim_workload_threads(void);
+void sim_gang_report(void);
+
+#endif
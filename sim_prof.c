@@ -0,0 +1,169 @@
+#ifdef SIM_PROF
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_prof.h"
+
+/*
+ * Only one thread runs at a time (see sim_engine.c), so the counters are
+ * plain globals; each thread keeps its own stack of open frames.
+ */
+
+static struct sim_prof_counter *sim_prof_counters;
+static int sim_prof_ncounters;
+static uint64_t sim_prof_start;
+static long long sim_prof_period;
+static long long sim_prof_next;
+
+static _Thread_local struct sim_prof_frame *sim_prof_top;
+/*
+ * Cycles this thread has spent parked, and when it last parked. A thread
+ * that has posted the baton is parked even if it runs on for a while
+ * (e.g. one that is exiting): the process it woke holds the baton.
+ */
+static _Thread_local uint64_t sim_prof_parked;
+static _Thread_local uint64_t sim_prof_parked_at;
+static _Thread_local bool sim_prof_isparked;
+/* When the baton was last posted */
+static uint64_t sim_prof_handoff_at;
+static struct sim_prof_counter sim_prof_handoff = { .name = "(baton handoff)" };
+
+static uint64_t _sim_prof_parked(uint64_t now)
+{
+	return sim_prof_parked + (sim_prof_isparked ? now - sim_prof_parked_at : 0);
+}
+
+static void _sim_prof_atexit(void)
+{
+	sim_prof_report(-1);
+}
+
+static void _sim_prof_register(struct sim_prof_counter *counter)
+{
+	if (sim_prof_counters == NULL) {
+		sim_prof_start = sim_prof_tsc();
+		atexit(_sim_prof_atexit);
+	}
+	counter->registered = true;
+	counter->next = sim_prof_counters;
+	sim_prof_counters = counter;
+	sim_prof_ncounters++;
+}
+
+void sim_prof_enter(struct sim_prof_frame *frame, struct sim_prof_counter *counter)
+{
+	if (!counter->registered)
+		_sim_prof_register(counter);
+	frame->counter = counter;
+	frame->child = 0;
+	frame->parent = sim_prof_top;
+	sim_prof_top = frame;
+	frame->start = sim_prof_tsc();
+	frame->parked = _sim_prof_parked(frame->start);
+}
+
+void sim_prof_leave(struct sim_prof_frame *frame)
+{
+	uint64_t now = sim_prof_tsc();
+	uint64_t elapsed = now - frame->start - (_sim_prof_parked(now) - frame->parked);
+	struct sim_prof_counter *counter = frame->counter;
+	struct sim_prof_frame *outer;
+
+	counter->calls++;
+	counter->self += elapsed - frame->child;
+	/* a recursive activation is already inside the outer one's total */
+	for (outer = frame->parent; outer != NULL && outer->counter != counter; outer = outer->parent)
+		;
+	if (outer == NULL)
+		counter->total += elapsed;
+	sim_prof_top = frame->parent;
+	if (sim_prof_top != NULL)
+		sim_prof_top->child += elapsed;
+}
+
+void sim_prof_park(void)
+{
+	sim_prof_parked_at = sim_prof_handoff_at = sim_prof_tsc();
+	sim_prof_isparked = true;
+}
+
+void sim_prof_unpark(void)
+{
+	uint64_t now = sim_prof_tsc();
+
+	if (!sim_prof_handoff.registered)
+		_sim_prof_register(&sim_prof_handoff);
+	sim_prof_handoff.calls++;
+	sim_prof_handoff.self += now - sim_prof_handoff_at;
+	sim_prof_handoff.total += now - sim_prof_handoff_at;
+	/* a new thread has not parked before: it has no open frames either */
+	if (sim_prof_isparked)
+		sim_prof_parked += now - sim_prof_parked_at;
+	sim_prof_isparked = false;
+}
+
+void sim_prof_set_period(long long period)
+{
+	sim_prof_period = period;
+	sim_prof_next = period;
+}
+
+/* The time spent reporting is left out, as if the thread had been parked */
+void sim_prof_tick(long long clock)
+{
+	uint64_t start;
+
+	if (sim_prof_period <= 0 || clock < sim_prof_next)
+		return;
+	start = sim_prof_tsc();
+	sim_prof_report(clock);
+	start = sim_prof_tsc() - start;
+	sim_prof_parked += start;
+	sim_prof_start += start;
+	sim_prof_next = clock - clock % sim_prof_period + sim_prof_period;
+}
+
+static int _sim_prof_cmp(const void *a, const void *b)
+{
+	const struct sim_prof_counter *x = *(struct sim_prof_counter * const *)a;
+	const struct sim_prof_counter *y = *(struct sim_prof_counter * const *)b;
+
+	return x->self < y->self ? 1 : x->self > y->self ? -1 : 0;
+}
+
+/* Print every counter, most self time first; clock < 0 for the final summary */
+void sim_prof_report(long long clock)
+{
+	struct sim_prof_counter **sorted, *counter;
+	uint64_t elapsed = sim_prof_tsc() - sim_prof_start, profiled = 0;
+	int i, n = 0;
+
+	sorted = malloc(sim_prof_ncounters * sizeof(*sorted));
+	if (sorted == NULL)
+		return;
+	for (counter = sim_prof_counters; counter != NULL; counter = counter->next) {
+		sorted[n++] = counter;
+		profiled += counter->self;
+	}
+	qsort(sorted, n, sizeof(*sorted), _sim_prof_cmp);
+
+	if (clock < 0)
+		fprintf(stderr, "[Prof] summary: %llu cycles\n", (unsigned long long)elapsed);
+	else
+		fprintf(stderr, "[Prof] at %lld.%03lld: %llu cycles\n", clock / 1000, clock % 1000, (unsigned long long)elapsed);
+	fprintf(stderr, "[Prof] %-28s %12s %16s %6s %12s %16s\n", "entry point", "calls", "self cycles", "self%", "cycles/call", "total cycles");
+	for (i = 0; i < n; i++) {
+		counter = sorted[i];
+		fprintf(stderr, "[Prof] %-28s %12llu %16llu %5.1f%% %12llu %16llu\n", counter->name, counter->calls,
+			(unsigned long long)counter->self, elapsed ? counter->self * 100.0 / elapsed : 0.0,
+			counter->calls ? (unsigned long long)(counter->self / counter->calls) : 0ULL,
+			(unsigned long long)counter->total);
+	}
+	fprintf(stderr, "[Prof] %-28s %12s %16llu %5.1f%%\n", "(not instrumented)", "",
+		(unsigned long long)(elapsed > profiled ? elapsed - profiled : 0),
+		elapsed > profiled ? (elapsed - profiled) * 100.0 / elapsed : 0.0);
+	free(sorted);
+}
+
+#endif
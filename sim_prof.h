@@ -0,0 +1,94 @@
+#ifndef SIM_PROF_H
+#define SIM_PROF_H
+
+/*
+ * Host-side profiling: call counts and TSC cycles per instrumented entry
+ * point of the engine and the scheduler, to see where the host time of a
+ * run goes. Built only with -DSIM_PROF (link sim_prof.c as well); without
+ * it every macro below expands to nothing.
+ *
+ *   void f(void)
+ *   {
+ *           SIM_PROF_BEGIN();
+ *           ...
+ *           SIM_PROF_END();	(before every return)
+ *   }
+ *
+ * Cycles are self time: nested instrumented calls are charged to
+ * themselves, and the time a thread spends parked on its semaphore while
+ * another thread holds the baton is not charged at all (it is counted as
+ * "(baton handoff)" from the sem_post to the wakeup). Total is the
+ * inclusive time of the outermost activations. A summary goes to stderr
+ * at exit; sim_prof_set_period() adds one every period of simulated time.
+ */
+
+#ifdef SIM_PROF
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+struct sim_prof_counter {
+	const char *name;
+	unsigned long long calls;
+	uint64_t self;
+	uint64_t total;
+	bool registered;
+	struct sim_prof_counter *next;
+};
+
+struct sim_prof_frame {
+	struct sim_prof_counter *counter;
+	uint64_t start;
+	uint64_t child;	/* time of nested activations */
+	uint64_t parked;	/* sim_prof_parked at entry */
+	struct sim_prof_frame *parent;
+};
+
+/* Without a TSC, nanoseconds of the monotonic clock stand in for cycles */
+static inline uint64_t sim_prof_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+extern void sim_prof_enter(struct sim_prof_frame *frame, struct sim_prof_counter *counter);
+extern void sim_prof_leave(struct sim_prof_frame *frame);
+extern void sim_prof_park(void);
+extern void sim_prof_unpark(void);
+extern void sim_prof_tick(long long clock);
+extern void sim_prof_set_period(long long period);
+extern void sim_prof_report(long long clock);
+
+#define SIM_PROF_BEGIN() \
+	static struct sim_prof_counter _sim_prof_counter = { .name = __func__ }; \
+	struct sim_prof_frame _sim_prof_frame; \
+	sim_prof_enter(&_sim_prof_frame, &_sim_prof_counter)
+#define SIM_PROF_END() sim_prof_leave(&_sim_prof_frame)
+/* Around a baton handoff: before the sem_post, and after the sem_wait */
+#define SIM_PROF_PARK() sim_prof_park()
+#define SIM_PROF_UNPARK() sim_prof_unpark()
+#define SIM_PROF_TICK(clock) sim_prof_tick(clock)
+
+#else
+
+#define SIM_PROF_BEGIN()
+#define SIM_PROF_END()
+#define SIM_PROF_PARK()
+#define SIM_PROF_UNPARK()
+#define SIM_PROF_TICK(clock)
+
+#endif
+
+#endif
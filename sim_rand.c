@@ -0,0 +1,128 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "sim_rand.h"
+
+static uint64_t _sim_rand_splitmix(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static uint64_t _sim_rand_rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/*
+ * Derive an independent stream from (seed, stream); stream is e.g. a pid.
+ * The first half of the state is the splitmix sequence of the seed, the
+ * second half that of the stream mixed with it, so distinct pairs never
+ * share a state.
+ */
+void sim_rand_init(struct sim_rand *r, uint64_t seed, uint64_t stream)
+{
+	uint64_t x = seed;
+	uint64_t y;
+
+	r->s[0] = _sim_rand_splitmix(&x);
+	r->s[1] = _sim_rand_splitmix(&x);
+	y = stream ^ r->s[1];
+	r->s[2] = _sim_rand_splitmix(&y);
+	r->s[3] = _sim_rand_splitmix(&y);
+}
+
+/* Seed a child stream from the parent; the parent advances by one draw */
+void sim_rand_split(struct sim_rand *parent, struct sim_rand *child)
+{
+	uint64_t x = sim_rand_next(parent);
+
+	child->s[0] = _sim_rand_splitmix(&x);
+	child->s[1] = _sim_rand_splitmix(&x);
+	child->s[2] = _sim_rand_splitmix(&x);
+	child->s[3] = _sim_rand_splitmix(&x);
+}
+
+uint64_t sim_rand_next(struct sim_rand *r)
+{
+	uint64_t *s = r->s;
+	uint64_t result = _sim_rand_rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = _sim_rand_rotl(s[3], 45);
+
+	return result;
+}
+
+/* Uniform in [0, 1) */
+double sim_rand_double(struct sim_rand *r)
+{
+	return (sim_rand_next(r) >> 11) * 0x1.0p-53;
+}
+
+/* Uniform integer in [lo, hi] */
+int sim_rand_range(struct sim_rand *r, int lo, int hi)
+{
+	uint64_t n, limit, x;
+
+	if (hi <= lo)
+		return lo;
+	n = (uint64_t)((long long)hi - lo) + 1;
+	limit = UINT64_MAX - UINT64_MAX % n;
+	do {
+		x = sim_rand_next(r);
+	} while (x >= limit);
+
+	return lo + (int)(x % n);
+}
+
+double sim_rand_exp(struct sim_rand *r, double mean)
+{
+	return -mean * log(1.0 - sim_rand_double(r));
+}
+
+/* exp(N(mu, sigma^2)), normal drawn by Box-Muller */
+double sim_rand_lognormal(struct sim_rand *r, double mu, double sigma)
+{
+	double u1 = 1.0 - sim_rand_double(r);
+	double u2 = sim_rand_double(r);
+	double z = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+
+	return exp(mu + sigma * z);
+}
+
+double sim_rand_empirical(struct sim_rand *r, const struct sim_rand_empirical *dist)
+{
+	double total = 0.0, x;
+	int i;
+
+	for (i = 0; i < dist->count; i++)
+		total += dist->weight[i];
+
+	x = sim_rand_double(r) * total;
+	for (i = 0; i < dist->count - 1; i++) {
+		if (x < dist->weight[i])
+			break;
+		x -= dist->weight[i];
+	}
+
+	return dist->value[i];
+}
+
+/* Round a sampled length to a burst the engine accepts (at least 1 unit) */
+int sim_rand_burst(double x)
+{
+	if (x < 1.0)
+		return 1;
+	if (x > (double)INT32_MAX)
+		return INT32_MAX;
+	return (int)(x + 0.5);
+}
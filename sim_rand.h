@@ -0,0 +1,33 @@
+#ifndef SIM_RAND_H
+#define SIM_RAND_H
+
+#include <stdint.h>
+
+/*
+ * Seeded, splittable PRNG (xoshiro256**).
+ * Every stream is independent state owned by its user, so there is no
+ * global generator to serialize on and the same (seed, stream) pair
+ * always yields the same sequence.
+ */
+struct sim_rand {
+	uint64_t s[4];
+};
+
+/* Empirical distribution: value[i] is drawn with weight weight[i] */
+struct sim_rand_empirical {
+	int count;
+	const double *value;
+	const double *weight;
+};
+
+extern void sim_rand_init(struct sim_rand *r, uint64_t seed, uint64_t stream);
+extern void sim_rand_split(struct sim_rand *parent, struct sim_rand *child);
+extern uint64_t sim_rand_next(struct sim_rand *r);
+extern double sim_rand_double(struct sim_rand *r);
+extern int sim_rand_range(struct sim_rand *r, int lo, int hi);
+extern double sim_rand_exp(struct sim_rand *r, double mean);
+extern double sim_rand_lognormal(struct sim_rand *r, double mu, double sigma);
+extern double sim_rand_empirical(struct sim_rand *r, const struct sim_rand_empirical *dist);
+extern int sim_rand_burst(double x);
+
+#endif
@@ -3,84 +3,765 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <math.h>
+#include <time.h>
 #include <sys/queue.h>
-#include <time.h> // For srand
 
-#include "sim_engine.h"
+#include "sim_sched_advanced.h"
+#include "sim_gang.h"
+#include "sim_cluster.h"
+#include "sim_compare.h"
+#include "sim_prof.h"
+#include "sim_trace.h"
 
-#define SIM_MAXPROCS 100
-#define SIM_CPUMAXBURST 100 // Time slice for preemption
+struct sim_proc procs[SIM_MAXPROCS];
+int nextpid = 1;
+
+const char *sched_policy_names[] = {
+    [SCHED_PRIO] = "prio",
+    [SCHED_RR] = "rr",
+    [SCHED_FCFS] = "fcfs",
+    [SCHED_GANG] = "gang",
+    [SCHED_COSCHED] = "cosched",
+};
 
-// 定义进程优先级 (数值越小，优先级越高)
-#define PRIORITY_HIGH 1
-#define PRIORITY_NORMAL 2
-#define PRIORITY_LOW 3
+enum sim_sched_policy sched_policy = SCHED_PRIO;
+/* Simulation seed: the same seed reproduces the same trace */
+unsigned long long sim_seed = 1;
 
-enum sim_proc_state {
-    NOEXIST = 0,
-    READY,
-    RUNNING,
-    BLOCKED
+/* 每个 CPU 上正在运行的进程 */
+struct sim_proc *cpu_curr[SIM_ENGINE_MAXCPUS];
+int nr_cpus = 1;
+/* 集群 (-N): 节点 n 拥有 CPU [n * cpus_per_node, (n + 1) * cpus_per_node)，各自调度 */
+int nr_nodes = 1;
+int cpus_per_node = 1;
+/* 每个节点的可运行进程数 (READY + RUNNING) 及其对时间的积分，用于负载不均衡统计 */
+int node_load[SIM_MAXNODES];
+long long node_load_area[SIM_MAXNODES];
+long long node_spread_area; // (最大 - 最小节点负载) 对时间的积分
+long long node_load_since = 0;
+/* 已分派、还在网络上的作业数 (前端看到的负载包括它们) */
+int node_inflight[SIM_MAXNODES];
+/* Processes Queue for READY procs (每个 CPU 的运行队列由 proc_cpu 区分) */
+struct ready_queue ready_queue = TAILQ_HEAD_INITIALIZER(ready_queue);
+/* Processes Queue for BLOCKED procs */
+struct blocked_queue blocked_queue = TAILQ_HEAD_INITIALIZER(blocked_queue);
+/* Number of procs in READY state */
+int nr_ready = 0;
+/* Number of procs in LOCKWAIT state */
+int nr_lockwait = 0;
+/* 时间片模式: 0 = 固定 SIM_CPUMAXBURST, 1 = 自适应 */
+int adaptive_quantum = 0;
+/* -g 指定的调速器; eas 时由调度器按进程选择频率 */
+int energy_aware = 0;
+int energy_report = 0;
+int last_speed = 100;
+/* -c 指定了 CPU 配置时输出放置与响应时间的统计 */
+int cpu_report = 0;
+int irq_report = 0;
+int nr_migrations = 0;
+/* 按优先级统计 READY->RUNNING 的等待时间 (响应时间) */
+long long resp_total[PRIORITY_LOW + 1], resp_max[PRIORITY_LOW + 1];
+int resp_count[PRIORITY_LOW + 1];
+/*
+ * 调度开销 (-O): 调度器自身的工作按模型折算成时间，计入模拟时钟，作为
+ * 做出决策的 CPU 的系统时间 (见 sim_engine_syscharge)。count 模型按运行
+ * 队列的插入/删除次数和检查的元素个数计价；host 模型取宿主机上实测的
+ * 时间乘以系数，结果不再可重现。
+ */
+enum sim_cost_model {
+    COST_NONE = 0,
+    COST_COUNT,
+    COST_HOST
 };
+enum sim_cost_model cost_model = COST_NONE;
+long long cost_op_ns = 0;   // 每次运行队列插入/删除 (纳秒)
+long long cost_elem_ns = 0; // 每检查一个元素 (纳秒)
+double cost_host_scale = 1; // host: 实测时间的放大系数
+int cost_cpu = -1;          // sched_cpu 中: 开销计给被调度的 CPU；否则计给当前 CPU
+long long cost_host_start = 0; // host: 正在计时的决策的开始时刻，0 表示没在计时
+long long cost_ops = 0, cost_examined = 0, cost_decisions = 0, cost_total_ns = 0;
 
-struct sim_proc {
-    int proc_pid;
-    enum sim_proc_state proc_state;
-    struct sim_cpustate proc_cpustate;
-    int priority; // 新增：进程优先级
-    int creation_time; // 新增：进程创建时间，用于计算周转时间
+void sim_vm_report(void);
 
-    TAILQ_ENTRY(sim_proc) proc_list;
-} procs[SIM_MAXPROCS];
-int nextpid = 1;
+/* 分页模型: 物理页框数 (0 = 不模拟内存)、置换策略、每个进程的虚拟页数 */
+int vm_frames = 0;
+enum sim_vm_policy vm_policy = SIM_VM_CLOCK;
+#define VM_PROC_PAGES 64
 
-/* Active Process */
-struct sim_proc *activeproc = NULL;
-/* Processes Queue for READY procs */
-TAILQ_HEAD(ready_queue, sim_proc) ready_queue = TAILQ_HEAD_INITIALIZER(ready_queue);
-/* Processes Queue for BLOCKED procs */
-TAILQ_HEAD(blocked_queue, sim_proc) blocked_queue = TAILQ_HEAD_INITIALIZER(blocked_queue);
+/* 每个进程持有的 mutex，用于恢复有效优先级 */
+TAILQ_HEAD(sim_mutex_held, sim_mutex) mutex_held[SIM_MAXPROCS];
+
+/* 所有已初始化的同步对象，用于统计输出 */
+TAILQ_HEAD(sim_mutex_all, sim_mutex) mutex_all = TAILQ_HEAD_INITIALIZER(mutex_all);
+TAILQ_HEAD(sim_sem_all, sim_sem) sem_all = TAILQ_HEAD_INITIALIZER(sem_all);
+TAILQ_HEAD(sim_cond_all, sim_cond) cond_all = TAILQ_HEAD_INITIALIZER(cond_all);
+
+/* workload 中 mutex 使用的协议 (-p) */
+enum sim_mutex_protocol mutex_protocol = SIM_MUTEX_NONE;
 
 // 函数声明 (如果 sim_logging 定义在后面)
 void sim_logging(struct sim_proc *proc_p, const char *msg);
 
-void sched(void) {
+/* CPU 容量，按 SCHED_CAPACITY_SCALE 归一化 */
+int sim_cpu_capacity(int cpu) {
+    return sim_engine_cputype(cpu)->capacity * SCHED_CAPACITY_SCALE / 100;
+}
+
+/* 与内核的 fits_capacity 相同: 利用率加上 25% 余量后仍小于 CPU 容量 */
+bool sim_cpu_fits(int util, int cpu) {
+    return util * 1280 < sim_cpu_capacity(cpu) * 1024;
+}
+
+/*
+ * PELT 风格的利用率: 按几何级数衰减的运行时间占比。运行期间的贡献按所在
+ * CPU 的容量和当前频率缩放，所以同一个任务在大核、小核上得到的利用率
+ * 可以直接比较；一直在小核上运行的任务最多达到小核的容量。
+ */
+void sim_pelt_update(struct sim_proc *proc_p, long long clock) {
+    long long dt = clock - proc_p->util_update;
+    double decay;
+
+    if (dt <= 0)
+        return;
+    decay = exp2(-(double)dt / PELT_HALFLIFE);
+    if (proc_p->proc_state == RUNNING) {
+        int cap = sim_cpu_capacity(proc_p->proc_cpu) * sim_engine_freqs[sim_engine_getfreq()].speed / 100;
+        proc_p->util_avg = (int)(proc_p->util_avg * decay + cap * (1 - decay) + 0.5);
+    } else {
+        proc_p->util_avg = (int)(proc_p->util_avg * decay + 0.5);
+    }
+    proc_p->util_update = clock;
+}
+
+/* 节点负载变化 delta 之前，把各节点到现在为止的负载计入积分 */
+void sim_node_account(int node, int delta) {
+    long long clock = sim_engine_getclock();
+    int n, max = node_load[0], min = node_load[0];
+
+    if (clock > node_load_since) {
+        for (n = 0; n < nr_nodes; n++) {
+            node_load_area[n] += (long long)node_load[n] * (clock - node_load_since);
+            if (node_load[n] > max)
+                max = node_load[n];
+            if (node_load[n] < min)
+                min = node_load[n];
+        }
+        node_spread_area += (long long)(max - min) * (clock - node_load_since);
+        node_load_since = clock;
+    }
+    node_load[node] += delta;
+}
+
+void sim_cost_charge(long long ns) {
+    if (ns <= 0)
+        return;
+    cost_total_ns += ns;
+    sim_engine_syscharge(cost_cpu >= 0 ? cost_cpu : sim_engine_getcpu(), ns);
+}
+
+/* count 模型: ops 次运行队列操作、检查了 examined 个元素 */
+void sim_cost_count(int ops, int examined) {
+    if (cost_model != COST_COUNT)
+        return;
+    cost_ops += ops;
+    cost_examined += examined;
+    sim_cost_charge(ops * cost_op_ns + examined * cost_elem_ns);
+}
+
+long long sim_cost_hostns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * host 模型: 停止计时并把测得的时间计入，返回之前是否在计时。输出日志、
+ * 把 CPU 交给别的进程之前都要停下，决策嵌套时外层在内层结束后接着计时。
+ */
+bool sim_cost_stop(void) {
+    if (cost_host_start == 0)
+        return false;
+    sim_cost_charge((long long)((sim_cost_hostns() - cost_host_start) * cost_host_scale));
+    cost_host_start = 0;
+    return true;
+}
+
+void sim_cost_start(bool on) {
+    if (on)
+        cost_host_start = sim_cost_hostns();
+}
+
+/* 日志和 trace 中的名字: 多线程进程的线程是 Process#pid.tid */
+const char *sim_proc_name(struct sim_proc *proc_p) {
+    static char name[32];
+
+    if (proc_p->group != NULL)
+        sprintf(name, "Process#%d.%d", proc_p->proc_pid, proc_p->proc_tid);
+    else
+        sprintf(name, "Process#%d", proc_p->proc_pid);
+    return name;
+}
+
+/* trace 中每个线程一条轨道: 线程 0 沿用 pid，其余线程的编号放在高位 */
+int sim_proc_traceid(struct sim_proc *proc_p) {
+    return proc_p->proc_pid + (proc_p->proc_tid << SIM_TRACE_TID_SHIFT);
+}
+
+/*
+ * 重新判断 m 的各个等待者是否处于优先级反转，并累计反转的时间。只有 owner
+ * 正在运行、而等待者的优先级高于 owner 的有效优先级时才算: owner 自己被
+ * 抢占的时间，和被继承或天花板提升之后运行的时间都不算。
+ */
+void sim_mutex_inversion(struct sim_mutex *m) {
+    long long clock = sim_engine_getclock();
+    struct sim_proc *w;
+    bool inverted;
+
+    TAILQ_FOREACH(w, &m->waiters, proc_list) {
+        inverted = m->owner != NULL && m->owner->proc_state == RUNNING && w->priority < m->owner->priority;
+        if (inverted && w->inversion_since < 0) {
+            w->inversion_since = clock;
+        } else if (!inverted && w->inversion_since >= 0) {
+            w->inversion_time += clock - w->inversion_since;
+            w->inversion_since = -1;
+        }
+    }
+}
+
+/* proc_p 上下 CPU 或有效优先级变化时，它持有的 mutex 的等待者 */
+void sim_mutex_inversion_held(struct sim_proc *proc_p) {
+    struct sim_mutex *m;
+
+    TAILQ_FOREACH(m, &mutex_held[proc_p - procs], held_list)
+        sim_mutex_inversion(m);
+}
+
+/* 状态迁移：更新 proc_state，同时输出 trace 事件和就绪队列长度 */
+void sim_proc_setstate(struct sim_proc *proc_p, enum sim_proc_state state) {
+    long long clock = sim_engine_getclock();
+    bool qlen_changed = (proc_p->proc_state == READY) != (state == READY);
+    bool was_runnable = proc_p->proc_state == READY || proc_p->proc_state == RUNNING;
+    bool runnable = state == READY || state == RUNNING;
+    bool was_running = proc_p->proc_state == RUNNING;
+    struct sim_thread_group *g = proc_p->group;
+
+    sim_frag_integrate(clock);
+    sim_pelt_update(proc_p, clock);
+    if (was_runnable != runnable)
+        sim_node_account(proc_p->proc_node, runnable ? 1 : -1);
+    if (proc_p->proc_state == READY)
+        nr_ready--;
+    if (state == READY)
+        nr_ready++;
+    if (proc_p->proc_state == LOCKWAIT)
+        nr_lockwait--;
+    if (state == LOCKWAIT)
+        nr_lockwait++;
+    if (g != NULL) {
+        g->nr_ready += (state == READY) - (proc_p->proc_state == READY);
+        g->nr_running += (state == RUNNING) - (proc_p->proc_state == RUNNING);
+        if (state == RUNNING && g->first_run < 0)
+            g->first_run = clock;
+    }
+    proc_p->state_time[proc_p->proc_state] += clock - proc_p->state_since;
+    proc_p->state_since = clock;
+    if (proc_p->proc_state == RUNNING) {
+        proc_p->cur_burst += clock - proc_p->dispatch_time;
+        if (state != READY) { // 主动放弃 CPU，burst 结束
+            proc_p->avg_burst = proc_p->avg_burst > 0 ? (proc_p->avg_burst * 3 + proc_p->cur_burst) / 4 : proc_p->cur_burst;
+            proc_p->cur_burst = 0;
+        }
+    }
+    if (state == RUNNING) {
+        long long wait = clock - proc_p->ready_since;
+        int prio = proc_p->base_priority;
+
+        proc_p->dispatch_time = clock;
+        if (proc_p->first_run < 0)
+            proc_p->first_run = clock;
+        proc_p->nr_dispatch++;
+        resp_total[prio] += wait;
+        resp_count[prio]++;
+        if (wait > resp_max[prio])
+            resp_max[prio] = wait;
+    }
+    if (state == READY)
+        proc_p->ready_since = clock;
+    sim_trace_state(clock, sim_proc_traceid(proc_p), proc_p->proc_cpu, (enum sim_trace_pstate)proc_p->proc_state, (enum sim_trace_pstate)state);
+    if (qlen_changed) {
+        sim_trace_counter(clock, "ready_queue", nr_ready);
+        sim_cost_count(1, 0); // 进出 READY 就是一次就绪队列的插入/删除
+    }
+    proc_p->proc_state = state;
+    if (was_running != (state == RUNNING))
+        sim_mutex_inversion_held(proc_p);
+}
+
+/* cpu 的运行队列中的进程数 */
+int sim_nr_queued(int cpu) {
+    struct sim_proc *p;
+    int n = 0;
+
+    TAILQ_FOREACH(p, &ready_queue, proc_list) {
+        if (p->proc_cpu == cpu)
+            n++;
+    }
+    sim_cost_count(0, nr_ready);
+    return n;
+}
+
+/*
+ * 为即将运行的进程决定时间片。
+ * 自适应模式: 目标延迟按就绪进程数平分 (不低于最小粒度)；如果进程最近的
+ * burst 只比这个时间片稍长，就给足一个 burst，避免为剩下的一点点再排一次队。
+ */
+int sim_quantum(struct sim_proc *proc_p) {
+    int nr_running = sim_nr_queued(proc_p->proc_cpu) + 1;
+    int slice;
+    const char *reason;
+    char log_msg[100];
+
+    if (sched_policy == SCHED_FCFS)
+        return 0; // 不可抢占: 运行到主动放弃 CPU
+    if (sched_policy == SCHED_GANG && proc_p->group != NULL) // 同一组的线程在时间片结束时一起被抢占
+        return proc_p->group->slot_end > sim_engine_getclock() ? proc_p->group->slot_end - sim_engine_getclock() : 1;
+    if (!adaptive_quantum)
+        return SIM_CPUMAXBURST;
+
+    if (nr_running == 1) {
+        slice = SCHED_MAX_SLICE;
+        reason = "no other runnable process";
+    } else {
+        slice = SCHED_TARGET_LATENCY / nr_running;
+        reason = "target latency / nr_running";
+        if (slice < SCHED_MIN_GRANULARITY) {
+            slice = SCHED_MIN_GRANULARITY;
+            reason = "min granularity";
+        }
+        if (proc_p->avg_burst > slice && proc_p->avg_burst - proc_p->cur_burst <= slice * 2) {
+            slice = proc_p->avg_burst - proc_p->cur_burst;
+            if (slice < SCHED_MIN_GRANULARITY)
+                slice = SCHED_MIN_GRANULARITY;
+            reason = "fits recent burst";
+        }
+    }
+
+    sprintf(log_msg, "[Trace] Quantum %d (%s, %d runnable)", slice, reason, nr_running);
+    sim_logging(proc_p, log_msg);
+    sim_trace_counter(sim_engine_getclock(), "quantum", slice);
+    proc_p->slice_end = sim_engine_getclock() + slice;
+    return slice;
+}
+
+/*
+ * 有进程变为就绪时，正在运行的进程的时间片可能比新的公平份额长得多
+ * (例如它是在没有竞争时被调度的)。按新的就绪进程数缩短剩余时间片，
+ * 使交互式进程的响应时间仍然受目标延迟约束。
+ */
+void sim_quantum_rescale(int cpu) {
+    struct sim_proc *curr = cpu_curr[cpu];
+    long long clock = sim_engine_getclock();
+    long long end;
+    int nr_running, slice;
+    char log_msg[100];
+
+    if (!adaptive_quantum || sched_policy == SCHED_FCFS || sched_policy == SCHED_GANG || curr == NULL)
+        return;
+    nr_running = sim_nr_queued(cpu) + 1;
+    slice = SCHED_TARGET_LATENCY / nr_running;
+    if (slice < SCHED_MIN_GRANULARITY)
+        slice = SCHED_MIN_GRANULARITY;
+    end = curr->dispatch_time + slice;
+    if (end >= curr->slice_end)
+        return;
+    if (end < clock)
+        end = clock;
+    curr->slice_end = end;
+    sim_cpustate_setmaxburst(&curr->proc_cpustate, end - clock);
+    sprintf(log_msg, "[Trace] Quantum shortened to %lld (%d runnable)", end - curr->dispatch_time, nr_running);
+    sim_logging(curr, log_msg);
+    sim_trace_counter(clock, "quantum", end - curr->dispatch_time);
+}
+
+/*
+ * 为刚变为就绪的进程在它所在的节点内选择运行队列 (单 CPU 时总是 CPU 0):
+ * 1. 容得下它的空闲 CPU 中容量最小的 (轻任务留在小核)，同容量时优先上次的 CPU；
+ * 2. 否则容量最大的空闲 CPU；
+ * 3. 都在忙: 容得下它的 CPU 中队列最短的；都容不下时选容量最大的 CPU 中队列最短的。
+ */
+int sim_select_cpu(struct sim_proc *proc_p) {
+    int load[SIM_ENGINE_MAXCPUS];
+    int lo = proc_p->proc_node * cpus_per_node, hi = lo + cpus_per_node;
+    int c, best = -1, prev = proc_p->proc_cpu;
+    int util;
+    struct sim_proc *p;
+
+    if (cpus_per_node == 1)
+        return lo;
+    if (sched_policy == SCHED_GANG)
+        return sim_gang_select_cpu(proc_p);
+    sim_pelt_update(proc_p, sim_engine_getclock());
+    util = proc_p->util_avg;
+    for (c = lo; c < hi; c++)
+        load[c] = cpu_curr[c] != NULL;
+    TAILQ_FOREACH(p, &ready_queue, proc_list) {
+        if (p != proc_p && p->proc_node == proc_p->proc_node)
+            load[p->proc_cpu]++;
+    }
+    sim_cost_count(0, nr_ready);
+
+    for (c = lo; c < hi; c++) {
+        if (load[c] > 0 || !sim_cpu_fits(util, c))
+            continue;
+        if (best < 0 || sim_cpu_capacity(c) < sim_cpu_capacity(best) ||
+            (sim_cpu_capacity(c) == sim_cpu_capacity(best) && c == prev))
+            best = c;
+    }
+    if (best >= 0)
+        return best;
+    for (c = lo; c < hi; c++) {
+        if (load[c] == 0 && (best < 0 || sim_cpu_capacity(c) > sim_cpu_capacity(best)))
+            best = c;
+    }
+    if (best >= 0)
+        return best;
+    for (c = lo; c < hi; c++) {
+        if (sim_cpu_fits(util, c) && (best < 0 || load[c] < load[best] || (load[c] == load[best] && c == prev)))
+            best = c;
+    }
+    if (best >= 0)
+        return best;
+    for (c = lo; c < hi; c++) {
+        if (best < 0 || sim_cpu_capacity(c) > sim_cpu_capacity(best) ||
+            (sim_cpu_capacity(c) == sim_cpu_capacity(best) && load[c] < load[best]))
+            best = c;
+    }
+    return best;
+}
+
+void sched_cpu(int cpu);
+void sim_energy_setfreq(struct sim_proc *proc_p);
+
+/* 把 next 从就绪队列中取出、设为 cpu 上的当前进程，返回它的时间片 */
+int sim_dispatch(struct sim_proc *next, int cpu) {
+    char log_msg[100];
+
+    TAILQ_REMOVE(&ready_queue, next, proc_list); // 从就绪队列中移除
+    if (next->proc_cpu != cpu) {
+        sprintf(log_msg, "[Trace] Migrated CPU#%d->CPU#%d", next->proc_cpu, cpu);
+        sim_logging(next, log_msg);
+        next->proc_cpu = cpu;
+        nr_migrations++;
+    }
+    cpu_curr[cpu] = next;
+    sim_proc_setstate(next, RUNNING);
+    if (nr_cpus > 1) {
+        sprintf(log_msg, "[Trace] State change READY->RUNNING on CPU#%d", cpu);
+        sim_logging(next, log_msg);
+    } else {
+        sim_logging(next, "[Trace] State change READY->RUNNING");
+    }
+    if (energy_aware)
+        sim_energy_setfreq(next);
+    if (sim_engine_freqs[sim_engine_getfreq()].speed != last_speed) {
+        last_speed = sim_engine_freqs[sim_engine_getfreq()].speed;
+        sim_trace_counter(sim_engine_getclock(), "cpu_speed", last_speed);
+    }
+    return sim_quantum(next);
+}
+
+/* 在调用者以外的 CPU 上分派: 调用者接着运行，自己的 CPU 由它稍后决定 */
+void sim_dispatch_other(struct sim_proc *next, int cpu) {
+    sim_cpustate_dispatch(&next->proc_cpustate, cpu, sim_dispatch(next, cpu));
+}
+
+/* 把就绪的进程放进选定的运行队列：CPU 空闲则立即调度，否则按新的队列长度缩短时间片 */
+void sim_enqueue(struct sim_proc *proc_p) {
+    bool cost_outer = sim_cost_stop();
+    SIM_PROF_BEGIN();
+
+    sim_cost_start(cost_model == COST_HOST);
+    proc_p->proc_cpu = sim_select_cpu(proc_p);
+    if (cpu_curr[proc_p->proc_cpu] == NULL)
+        sched_cpu(proc_p->proc_cpu);
+    else
+        sim_quantum_rescale(proc_p->proc_cpu);
+    sim_cost_stop();
+    sim_cost_start(cost_outer);
+    SIM_PROF_END();
+}
+
+/*
+ * 能耗感知调度 (-g eas): 高优先级进程以最高频率运行以保证响应，
+ * 低优先级的批处理进程以单位工作能耗最低的频率运行，普通进程取两者中间。
+ */
+void sim_energy_setfreq(struct sim_proc *proc_p) {
+    int efficient = sim_engine_freq_efficient();
+    int level;
+    char log_msg[80];
+
+    if (proc_p->base_priority == PRIORITY_HIGH)
+        level = SIM_ENGINE_NFREQ - 1;
+    else if (proc_p->base_priority == PRIORITY_LOW)
+        level = efficient;
+    else
+        level = (efficient + SIM_ENGINE_NFREQ - 1 + 1) / 2;
+
+    if (level != sim_engine_getfreq()) {
+        sim_engine_setfreq(level);
+        sprintf(log_msg, "[Trace] CPU speed %d%%", sim_engine_freqs[level].speed);
+        sim_logging(proc_p, log_msg);
+    }
+}
+
+/* -c: CPU 配置、makespan、各 CPU 利用率和各优先级的响应时间 */
+void sim_cpu_report(void) {
+    long long clock = sim_engine_getclock();
+    int c, nbig = 0, prio;
+    char log_msg[200];
+
+    for (c = 0; c < nr_cpus; c++)
+        nbig += sim_engine_cputype(c)->capacity == sim_engine_cpu_big.capacity;
+    sprintf(log_msg, "[Stats] cpus: %d big + %d little, makespan %lld.%03llds, CPU utilization %.1f%%, %d migrations",
+        nbig, nr_cpus - nbig, clock / 1000, clock % 1000, sim_cpu_utilization(), nr_migrations);
+    sim_logging(NULL, log_msg);
+    for (c = 0; c < nr_cpus; c++) {
+        sprintf(log_msg, "[Stats] CPU#%d (%s): busy %lld, utilization %.1f%%", c, sim_engine_cputype(c)->name,
+            sim_engine_cpu_busytime(c), clock > 0 ? 100.0 * sim_engine_cpu_busytime(c) / clock : 0.0);
+        sim_logging(NULL, log_msg);
+    }
+    for (prio = PRIORITY_HIGH; prio <= PRIORITY_LOW; prio++) {
+        if (resp_count[prio] == 0)
+            continue;
+        sprintf(log_msg, "[Stats] response (READY->RUNNING) Prio%d: avg %.1f max %lld over %d dispatches",
+            prio, (double)resp_total[prio] / resp_count[prio], resp_max[prio], resp_count[prio]);
+        sim_logging(NULL, log_msg);
+    }
+}
+
+/*
+ * -O: 调度开销模型的计数，以及 CPU 时间按用户态 (进程的 burst)、系统态
+ * (调度开销) 和空闲的划分。计入的开销在 CPU 空闲时要等到下一次分派才
+ * 花掉，所以系统时间可能比计入的少一点。
+ */
+void sim_cost_report(void) {
+    long long clock = sim_engine_getclock();
+    long long user = 0, sys = 0, idle = 0;
+    int c;
+    char log_msg[200];
+
+    if (cost_model == COST_COUNT)
+        sprintf(log_msg, "[Stats] scheduling cost: %lldns per queue op, %lldns per element; %lld queue ops, %lld elements examined",
+            cost_op_ns, cost_elem_ns, cost_ops, cost_examined);
+    else
+        sprintf(log_msg, "[Stats] scheduling cost: host time x%g", cost_host_scale);
+    sim_logging(NULL, log_msg);
+    sprintf(log_msg, "[Stats] %lld decisions, %.3fms charged (%.1fus per decision)",
+        cost_decisions, cost_total_ns / 1e6, cost_decisions > 0 ? cost_total_ns / 1e3 / cost_decisions : 0.0);
+    sim_logging(NULL, log_msg);
+    for (c = 0; c < nr_cpus; c++) {
+        long long busy = sim_engine_cpu_busytime(c), s = sim_engine_cpu_systime(c);
+
+        user += busy - s;
+        sys += s;
+        idle += clock - busy;
+        if (nr_cpus > 1) {
+            sprintf(log_msg, "[Stats] CPU#%d: user %lld, system %lld, idle %lld", c, busy - s, s, clock - busy);
+            sim_logging(NULL, log_msg);
+        }
+    }
+    clock *= nr_cpus;
+    sprintf(log_msg, "[Stats] CPU time: user %lld (%.1f%%), system %lld (%.1f%%), idle %lld (%.1f%%)",
+        user, clock > 0 ? 100.0 * user / clock : 0.0, sys, clock > 0 ? 100.0 * sys / clock : 0.0,
+        idle, clock > 0 ? 100.0 * idle / clock : 0.0);
+    sim_logging(NULL, log_msg);
+}
+
+/* -i: 中断次数、按每次中断的固定开销估算的节省，以及合并带来的额外延迟 */
+void sim_irq_report(void) {
+    struct sim_engine_irqstats s;
+    char log_msg[200];
+
+    sim_engine_irqstats(&s);
+    sprintf(log_msg, "[Stats] interrupts: %d for %d I/O completions (%.2f per interrupt), overhead %.3fms, saved %.3fms at %dus/interrupt",
+        s.interrupts, s.completions, s.interrupts > 0 ? (double)s.completions / s.interrupts : 0.0,
+        s.interrupts * SIM_IRQ_COST_US / 1000.0, (s.completions - s.interrupts) * SIM_IRQ_COST_US / 1000.0, SIM_IRQ_COST_US);
+    sim_logging(NULL, log_msg);
+    sprintf(log_msg, "[Stats] coalescing latency: avg %.2f max %lld per completion",
+        s.completions > 0 ? (double)s.latency / s.completions : 0.0, s.max_latency);
+    sim_logging(NULL, log_msg);
+}
+
+void sim_energy_report(void) {
+    struct sim_engine_energy e;
+    char log_msg[200];
+    int i, len = 0;
+
+    sim_engine_energy(&e);
+    sprintf(log_msg, "[Stats] energy: %.3f J (busy %.3f J, idle %.3f J), makespan %lld.%03llds, %d frequency changes",
+        e.busy_joules + e.idle_joules, e.busy_joules, e.idle_joules,
+        sim_engine_getclock() / 1000, sim_engine_getclock() % 1000, e.transitions);
+    sim_logging(NULL, log_msg);
+    for (i = 0; i < SIM_ENGINE_NFREQ; i++)
+        len += sprintf(log_msg + len, "%s%d%%=%lld", i ? " " : "[Stats] busy time per speed: ", sim_engine_freqs[i].speed, e.busy_time[i]);
+    sim_logging(NULL, log_msg);
+    len = 0;
+    for (i = 0; i < SIM_ENGINE_NIDLE; i++)
+        len += sprintf(log_msg + len, "%s%s=%lld", i ? " " : "[Stats] idle state residency: ", sim_engine_idlestates[i].name, e.idle_time[i]);
+    sim_logging(NULL, log_msg);
+    if (sim_engine_fastforward_skipped() > 0) {
+        sprintf(log_msg, "[Stats] fast-forward: %lld governor samples skipped", sim_engine_fastforward_skipped());
+        sim_logging(NULL, log_msg);
+    }
+}
+
+/* 就绪队列的排序键，越小越先运行；键相同时按队列顺序 (先来先服务) */
+int sim_sched_key(struct sim_proc *proc_p) {
+    return sched_policy == SCHED_PRIO ? proc_p->priority : PRIORITY_HIGH;
+}
+
+/*
+ * 选出 cpu 上下一个运行的进程: 本 CPU 运行队列中优先级最高的；队列为空时
+ * 从同一节点其他 CPU 的队列中窃取 (优先窃取容得下的)，再没有就把在更小的
+ * CPU 上容不下 (misfit) 的运行中进程拉过来。
+ */
+void sched_cpu(int cpu) {
     struct sim_proc *p, *highest_priority_proc = NULL;
     int min_priority = PRIORITY_LOW + 1; // Initialize with a value lower than any possible priority
+    int node = cpu / cpus_per_node, lo = node * cpus_per_node, hi = lo + cpus_per_node;
+    int pass, c, slice, examined = 0;
+    bool gang = sched_policy == SCHED_GANG;
+    int cost_outer_cpu = cost_cpu;
+    bool cost_outer = sim_cost_stop();
+    char log_msg[100];
+    SIM_PROF_BEGIN();
+
+    cost_cpu = cpu;
+    cost_decisions++;
+    sim_cost_start(cost_model == COST_HOST);
+    sim_frag_integrate(sim_engine_getclock());
 
     /* 1. 如果当前有活动进程，保存其状态并放回就绪队列尾部 */
-    if (activeproc != NULL) {
-        sim_cpustate_save(&activeproc->proc_cpustate);
-        TAILQ_INSERT_TAIL(&ready_queue, activeproc, proc_list);
-        activeproc->proc_state = READY;
-        sim_logging(activeproc, "[Trace] State change RUNNING->READY (scheduler called)");
-        activeproc = NULL;
+    if (cpu_curr[cpu] != NULL) {
+        p = cpu_curr[cpu];
+        sim_cpustate_save(&p->proc_cpustate);
+        TAILQ_INSERT_TAIL(&ready_queue, p, proc_list);
+        sim_proc_setstate(p, READY);
+        sim_logging(p, "[Trace] State change RUNNING->READY (scheduler called)");
+        cpu_curr[cpu] = NULL;
+        /* 在这个 CPU 上容不下的进程，有更大的空闲 CPU 时迁移过去 */
+        if (cpus_per_node > 1 && !sim_cpu_fits(p->util_avg, cpu)) {
+            c = sim_select_cpu(p);
+            if (cpu_curr[c] == NULL && sim_cpu_capacity(c) > sim_cpu_capacity(cpu)) {
+                sprintf(log_msg, "[Trace] Misfit on CPU#%d (util %d), moving to CPU#%d", cpu, p->util_avg, c);
+                sim_logging(p, log_msg);
+                p->proc_cpu = c;
+                sched_cpu(c);
+            }
+        }
     }
 
     /* 2. 从就绪队列中挑选一个新进程 (实现优先级调度) */
+    if (gang)
+        highest_priority_proc = sim_gang_pick(cpu, &examined);
+    else if (sched_policy == SCHED_COSCHED)
+        highest_priority_proc = sim_cosched_pick(cpu, &examined);
     // 遍历就绪队列，找到优先级最高的进程 (priority值最小)
-    TAILQ_FOREACH(p, &ready_queue, proc_list) {
-        if (p->priority < min_priority) {
-            min_priority = p->priority;
-            highest_priority_proc = p;
+    if (highest_priority_proc == NULL && !gang) {
+        TAILQ_FOREACH(p, &ready_queue, proc_list) {
+            examined++;
+            if (p->proc_cpu == cpu && sim_sched_key(p) < min_priority) {
+                min_priority = sim_sched_key(p);
+                highest_priority_proc = p;
+            }
         }
     }
-    
-    activeproc = highest_priority_proc; // 将找到的最高优先级进程设为活动进程
+    for (pass = 0; highest_priority_proc == NULL && !gang && pass < 2; pass++) {
+        TAILQ_FOREACH(p, &ready_queue, proc_list) {
+            examined++;
+            if (p->proc_node == node && (pass == 1 || sim_cpu_fits(p->util_avg, cpu)) && sim_sched_key(p) < min_priority) {
+                min_priority = sim_sched_key(p);
+                highest_priority_proc = p;
+            }
+        }
+    }
+    sim_cost_count(0, examined);
+    if (highest_priority_proc == NULL && cpus_per_node > 1 && !gang) {
+        struct sim_proc *misfit = NULL;
 
-    if (activeproc != NULL) {
-        TAILQ_REMOVE(&ready_queue, activeproc, proc_list); // 从就绪队列中移除
-        activeproc->proc_state = RUNNING;
-        sim_logging(activeproc, "[Trace] State change READY->RUNNING");
-        sim_cpustate_restore(&activeproc->proc_cpustate, SIM_CPUMAXBURST);
+        for (c = lo; c < hi; c++) {
+            p = cpu_curr[c];
+            if (p == NULL || p == activeproc || sim_cpu_capacity(c) >= sim_cpu_capacity(cpu))
+                continue;
+            sim_pelt_update(p, sim_engine_getclock());
+            if (!sim_cpu_fits(p->util_avg, c) && (misfit == NULL || p->util_avg > misfit->util_avg))
+                misfit = p;
+        }
+        if (misfit != NULL) {
+            c = misfit->proc_cpu;
+            sim_cpustate_save(&misfit->proc_cpustate);
+            cpu_curr[c] = NULL;
+            sim_proc_setstate(misfit, READY);
+            sprintf(log_msg, "[Trace] Misfit on CPU#%d (util %d), pulled to CPU#%d", c, misfit->util_avg, cpu);
+            sim_logging(misfit, log_msg);
+            misfit->proc_cpu = cpu;
+            /* 先重新调度被拉空的 CPU；此时 misfit 还不在就绪队列中，不会被它窃取回去 */
+            sched_cpu(c);
+            TAILQ_INSERT_TAIL(&ready_queue, misfit, proc_list);
+            highest_priority_proc = misfit;
+        }
+    }
+
+    if (highest_priority_proc != NULL) {
+        struct sim_proc *next = highest_priority_proc;
+
+        slice = sim_dispatch(next, cpu);
+        if (sched_policy == SCHED_COSCHED && next->group != NULL)
+            sim_cosched_pull(next->group, cpu);
+        /* 决策到此结束: 恢复进程可能把 CPU 交出去，计时必须先停下 */
+        sim_cost_stop();
+        cost_cpu = cost_outer_cpu;
+        sim_cpustate_restore_cpu(&next->proc_cpustate, cpu, slice);
+        sim_cost_start(cost_outer);
+        SIM_PROF_END();
+        return;
+    }
+    sim_cost_stop();
+    cost_cpu = cost_outer_cpu;
+
+    for (c = 0; c < nr_cpus; c++) {
+        if (cpu_curr[c] != NULL)
+            break; // 其他 CPU 上的进程还可能释放锁
+    }
+    if (c == nr_cpus && TAILQ_EMPTY(&blocked_queue) && nr_lockwait > 0) {
+        /* 没有可运行的进程，也没有等待 I/O 的进程：只剩等待锁的进程 */
+        sprintf(log_msg, "[Error] Deadlock: %d process(es) waiting on synchronization objects", nr_lockwait);
+        sim_logging(NULL, log_msg);
+        sim_trace_close();
+        exit(1);
+    } else if (nr_cpus > 1) {
+        sprintf(log_msg, "[Trace] CPU#%d idle, waiting for next interrupt", cpu);
+        sim_logging(NULL, log_msg);
+        if (nr_nodes > 1)
+            sim_cluster_idle(node);
+        if (cpu == sim_engine_getcpu())
+            sim_wait_nextintr();
     } else {
         sim_logging(NULL, "[Trace] No active process, waiting for next interrupt");
         sim_wait_nextintr();
     }
+    sim_cost_start(cost_outer);
+    SIM_PROF_END();
+}
+
+void sched(void) {
+    sched_cpu(sim_engine_getcpu());
 }
 
 // 修改 sim_createproc 以接受优先级参数
-int sim_createproc(void (*func)(void), int priority) {
+struct sim_proc *sim_allocproc(void (*func)(void), int priority, struct sim_thread_group *group) {
     int i;
 
     for (i = 0; i < SIM_MAXPROCS; i++) {
@@ -88,58 +769,125 @@ int sim_createproc(void (*func)(void), int priority) {
             break;
     }
     if (i >= SIM_MAXPROCS)
-        return 0; 
+        return NULL; 
+    SIM_PROF_BEGIN();
 
-    procs[i].proc_pid = nextpid++;
+    procs[i].group = group;
+    procs[i].proc_tid = 0;
+    if (group != NULL && group->nr_threads > 0) {
+        procs[i].proc_pid = group->pid; // 同一进程的线程共享 pid
+        procs[i].proc_tid = group->nr_threads;
+    } else {
+        procs[i].proc_pid = nextpid++;
+    }
+    if (group != NULL) {
+        group->pid = procs[i].proc_pid;
+        group->nr_threads++;
+        group->nr_live++;
+    }
     procs[i].priority = priority; // 设置优先级
+    procs[i].base_priority = priority;
     procs[i].creation_time = sim_engine_getclock(); // 记录创建时间
+    /* 线程 0 与单线程进程的随机数流相同，其余线程各用一个 */
+    sim_rand_init(&procs[i].proc_rand, sim_seed, procs[i].proc_pid + ((unsigned long long)procs[i].proc_tid << 32));
+    procs[i].wait_mutex = NULL;
+    TAILQ_INIT(&mutex_held[i]);
+    if (vm_frames > 0)
+        sim_vm_space_init(&procs[i].proc_vm, procs[i].proc_pid, VM_PROC_PAGES);
     
     sim_loadproc(func, &procs[i].proc_cpustate, &procs[i]);
-    procs[i].proc_state = READY;
-    TAILQ_INSERT_TAIL(&ready_queue, &procs[i], proc_list); // 插入就绪队列尾部
-    
     char log_msg[100];
+    sprintf(log_msg, "%s(Prio%d)", sim_proc_name(&procs[i]), priority);
+    sim_trace_proc(sim_proc_traceid(&procs[i]), log_msg);
+    procs[i].proc_cpu = 0;
+    procs[i].util_avg = 0;
+    procs[i].util_update = procs[i].creation_time;
+    procs[i].proc_node = 0;
+    procs[i].arrival_time = -1;
+    procs[i].in_flight = false;
+    procs[i].state_since = procs[i].creation_time;
+    memset(procs[i].state_time, 0, sizeof(procs[i].state_time));
+    procs[i].first_run = -1;
+    procs[i].nr_dispatch = 0;
+    procs[i].cur_burst = 0; // 槽位可能被复用，不能继承上一个进程的 burst 统计
+    procs[i].avg_burst = 0;
+
+    SIM_PROF_END();
+    return &procs[i];
+}
+
+int sim_createproc(void (*func)(void), int priority) {
+    struct sim_proc *proc_p = sim_allocproc(func, priority, NULL);
+    char log_msg[100];
+
+    if (proc_p == NULL)
+        return 0;
+    sim_proc_setstate(proc_p, READY);
+    TAILQ_INSERT_TAIL(&ready_queue, proc_p, proc_list); // 插入就绪队列尾部
+    proc_p->proc_cpu = sim_select_cpu(proc_p);
+    
     sprintf(log_msg, "Created as state READY with priority %d", priority);
-    sim_logging(&procs[i], log_msg);
+    sim_logging(proc_p, log_msg);
 
-    return procs[i].proc_pid; 
+    return proc_p->proc_pid; 
 }
 
-int sim_iorequest(int iowait) {
+int sim_iorequest(long long iowait) {
     if (activeproc == NULL) { 
         sim_logging(NULL, "[Error] I/O request from non-active process context!");
         return 0;
     }
+    SIM_PROF_BEGIN();
     sim_deviorequest(iowait); 
+    sim_trace_io(sim_engine_getclock(), sim_proc_traceid(activeproc), 0, iowait);
 
     sim_cpustate_save(&activeproc->proc_cpustate);
     TAILQ_INSERT_TAIL(&blocked_queue, activeproc, proc_list);
-    activeproc->proc_state = BLOCKED;
+    sim_proc_setstate(activeproc, BLOCKED);
     sim_logging(activeproc, "[Trace] State change RUNNING->BLOCKED (I/O request)");
     
     activeproc = NULL; 
     sched();
+    SIM_PROF_END();
     return 1;
 }
 
-void sim_intr_devioready(void *_proc_p) {
-    struct sim_proc *proc_p = _proc_p;
-
+/* I/O 完成: 把进程放回就绪队列。返回 false 表示不需要调度 (进程无效，或者是刚到达前端的作业) */
+bool sim_ioready(struct sim_proc *proc_p) {
     if (proc_p == NULL || proc_p->proc_state == NOEXIST) {
         char log_buf[128];
         sprintf(log_buf, "[Trace] I/O ready for an already exited/invalid process (PID if available: %d)", proc_p ? proc_p->proc_pid : -1);
         sim_logging(NULL, log_buf); // Use NULL if proc_p is truly invalid
-        return;
+        return false;
     }
     
     if (proc_p->proc_state != BLOCKED) {
         sim_logging(proc_p, "[Warning] I/O ready for a process not in BLOCKED state!");
     }
+    if (proc_p->proc_node < 0) { // 作业到达前端
+        sim_cluster_dispatch(proc_p);
+        return false;
+    }
+    if (proc_p->in_flight) { // 作业经过网络到达节点
+        proc_p->in_flight = false;
+        node_inflight[proc_p->proc_node]--;
+    }
 
     TAILQ_REMOVE(&blocked_queue, proc_p, proc_list); 
-    proc_p->proc_state = READY;
+    sim_proc_setstate(proc_p, READY);
     TAILQ_INSERT_TAIL(&ready_queue, proc_p, proc_list); // I/O完成的进程回到就绪队列尾部
     sim_logging(proc_p, "[Trace] State change BLOCKED->READY (I/O ready interrupt)");
+    return true;
+}
+
+void sim_intr_devioready(void *_proc_p) {
+    struct sim_proc *proc_p = _proc_p;
+    SIM_PROF_BEGIN();
+
+    if (!sim_ioready(proc_p)) {
+        SIM_PROF_END();
+        return;
+    }
 
     // 考虑抢占：如果当前没有活动进程，或者新就绪的进程优先级高于当前活动进程
     // 为简化，这里我们仅在CPU空闲时或由时间片中断调用sched()。
@@ -148,19 +896,47 @@ void sim_intr_devioready(void *_proc_p) {
     // 当前的sched()总会把activeproc放回队列再选，所以当因其他原因调用sched时，优先级会起作用。
     // 如果希望I/O完成时能立即抢占低优先级当前进程，需要更复杂的逻辑或总是调用sched()。
     // 简单的处理：如果CPU空闲，则调度
-    if (activeproc == NULL) {
-        sched();
-    } 
+    sim_enqueue(proc_p);
     // 可选的更积极抢占: 如果新就绪的进程优先级更高
     /* else if (proc_p->priority < activeproc->priority) {
         sim_logging(activeproc, "[Trace] High priority process became ready, attempting preemption");
         sched(); // 强制调度，可能会抢占当前activeproc
     }
     */
+    SIM_PROF_END();
+}
+
+/*
+ * 合并后的 I/O 中断 (-i): 先把这一批进程全部放回就绪队列、选好 CPU，
+ * 再对每个 CPU 只做一次调度决策。
+ */
+void sim_intr_devioready_batch(void **_procs, int n) {
+    int i, c;
+    char log_msg[80];
+    SIM_PROF_BEGIN();
+
+    sprintf(log_msg, "[Trace] I/O interrupt: %d completion(s)", n);
+    sim_logging(NULL, log_msg);
+    for (i = 0; i < n; i++) {
+        struct sim_proc *proc_p = _procs[i];
+
+        if (sim_ioready(proc_p))
+            proc_p->proc_cpu = sim_select_cpu(proc_p);
+    }
+    for (c = 0; c < nr_cpus; c++) {
+        if (sim_nr_queued(c) == 0)
+            continue;
+        if (cpu_curr[c] == NULL)
+            sched_cpu(c);
+        else
+            sim_quantum_rescale(c);
+    }
+    SIM_PROF_END();
 }
 
 void sim_intr_cpurunout(void *_proc_p) {
     struct sim_proc *proc_p = (struct sim_proc *)_proc_p;
+    SIM_PROF_BEGIN();
     if (proc_p == activeproc && proc_p != NULL) { // 确保是当前活动进程的时间片用完
         sim_logging(proc_p, "[Trace] CPU time slice expired (CPU runout interrupt)");
         sched(); // 调用调度器重新选择进程
@@ -168,43 +944,302 @@ void sim_intr_cpurunout(void *_proc_p) {
         // 可能是一个延迟的中断，或者activeproc已经被改变
         sim_logging(proc_p, "[Warning] CPU runout for non-active or changed process!");
     }
+    SIM_PROF_END();
 }
 
 void sim_intr_procexit(void *_proc_p) {
     struct sim_proc *proc_p = _proc_p;
-    int turnaround_time = sim_engine_getclock() - proc_p->creation_time;
+    long long turnaround_time = sim_engine_getclock() - proc_p->creation_time;
     
     char log_msg[128];
-    sprintf(log_msg, "Terminated. Turnaround Time: %d.%03ds", turnaround_time / 1000, turnaround_time % 1000);
+    SIM_PROF_BEGIN();
+    sprintf(log_msg, "Terminated. Turnaround Time: %lld.%03llds", turnaround_time / 1000, turnaround_time % 1000);
     sim_logging(proc_p, log_msg);
+    if (proc_p->arrival_time >= 0)
+        sim_cluster_done(proc_p);
+    if (proc_p->proc_vm.accesses > 0) {
+        sprintf(log_msg, "[Stats] Page faults: %d / %d accesses, %d writebacks",
+            proc_p->proc_vm.faults, proc_p->proc_vm.accesses, proc_p->proc_vm.writebacks);
+        sim_logging(proc_p, log_msg);
+    }
+    sim_vm_space_free(&proc_p->proc_vm);
 
+    sim_frag_integrate(sim_engine_getclock());
     if (activeproc == proc_p) {
         activeproc = NULL;
     }
     // 如果它在其他队列中（理论上不应该，因为是运行后退出的），也应该移除。
     // 但在此模拟中，它应该是activeproc，或者已经被移出。
     
-    proc_p->proc_state = NOEXIST; 
+    sim_proc_setstate(proc_p, NOEXIST);
+    if (proc_p->arrival_time >= 0 && job_pending >= 0) // 腾出了槽位，补上因进程表满而推迟的到达
+        sim_cluster_next(job_pending);
+    if (proc_p->group != NULL)
+        sim_thread_exit(proc_p);
+    else if (compare_out != NULL)
+        sim_compare_record(proc_p);
     // 不能立即memset，因为proc_p可能在sim_engine的proc_list中还被引用直到线程结束。
     // engine 的 _sim_loadproc2 中会free(engine_proc_cb_p)，
     // 而 engine_proc_cb_p->proc_cb_p 就是这里的 proc_p。
     // memset(proc_p, 0, sizeof(*proc_p)); // 暂时注释掉以防万一，NOEXIST状态是关键
 
     sched();
+    SIM_PROF_END();
+}
+
+/* --- 进程间同步原语: mutex / semaphore / condition variable --- */
+
+void sim_mutex_init(struct sim_mutex *m, const char *name, enum sim_mutex_protocol protocol, int ceiling) {
+    memset(m, 0, sizeof(*m));
+    m->name = name;
+    m->protocol = protocol;
+    m->ceiling = ceiling;
+    TAILQ_INIT(&m->waiters);
+    TAILQ_INSERT_TAIL(&mutex_all, m, all_list);
+}
+
+void sim_sem_init(struct sim_sem *sem, const char *name, int count) {
+    memset(sem, 0, sizeof(*sem));
+    sem->name = name;
+    sem->count = count;
+    TAILQ_INIT(&sem->waiters);
+    TAILQ_INSERT_TAIL(&sem_all, sem, all_list);
+}
+
+void sim_cond_init(struct sim_cond *c, const char *name) {
+    memset(c, 0, sizeof(*c));
+    c->name = name;
+    TAILQ_INIT(&c->waiters);
+    TAILQ_INSERT_TAIL(&cond_all, c, all_list);
+}
+
+/* 重新计算有效优先级: 基础优先级、继承自等待者的优先级、天花板中最高的一个 */
+void sim_proc_update_priority(struct sim_proc *proc_p) {
+    struct sim_mutex *m;
+    struct sim_proc *w;
+    int prio = proc_p->base_priority;
+
+    TAILQ_FOREACH(m, &mutex_held[proc_p - procs], held_list) {
+        if (m->protocol == SIM_MUTEX_CEILING && m->ceiling < prio)
+            prio = m->ceiling;
+        if (m->protocol == SIM_MUTEX_INHERIT) {
+            TAILQ_FOREACH(w, &m->waiters, proc_list) {
+                if (w->priority < prio)
+                    prio = w->priority;
+            }
+        }
+    }
+    if (prio != proc_p->priority) {
+        char log_msg[80];
+        sprintf(log_msg, "[Trace] Priority %d->%d", proc_p->priority, prio);
+        proc_p->priority = prio;
+        sim_logging(proc_p, log_msg);
+        sim_mutex_inversion_held(proc_p);
+        if (proc_p->wait_mutex != NULL)
+            sim_mutex_inversion(proc_p->wait_mutex);
+    }
+}
+
+/* 沿着 "owner 又在等待另一个 mutex" 的链传递优先级继承 */
+void sim_mutex_propagate(struct sim_mutex *m) {
+    while (m != NULL && m->protocol == SIM_MUTEX_INHERIT && m->owner != NULL) {
+        sim_proc_update_priority(m->owner);
+        m = m->owner->wait_mutex;
+    }
+}
+
+/* 当前进程在 waitq 上阻塞，直到被 sim_sync_wakeup 唤醒并再次被调度 */
+void sim_sync_block(struct sim_waitq *waitq, const char *what, const char *name) {
+    char log_msg[100];
+
+    activeproc->wait_since = sim_engine_getclock();
+    sim_cpustate_save(&activeproc->proc_cpustate);
+    TAILQ_INSERT_TAIL(waitq, activeproc, proc_list);
+    sim_proc_setstate(activeproc, LOCKWAIT);
+    sprintf(log_msg, "[Trace] State change RUNNING->LOCKWAIT (%s %s)", what, name);
+    sim_logging(activeproc, log_msg);
+    /* 在调度之前把优先级继承传递给 owner */
+    sim_mutex_propagate(activeproc->wait_mutex);
+    if (activeproc->wait_mutex != NULL)
+        sim_mutex_inversion(activeproc->wait_mutex);
+
+    activeproc = NULL;
+    sched();
+}
+
+/* waitq 为 NULL 时调用者已经把进程移出了等待队列 */
+void sim_sync_wakeup(struct sim_waitq *waitq, struct sim_proc *proc_p, const char *what, const char *name) {
+    char log_msg[100];
+
+    if (waitq != NULL)
+        TAILQ_REMOVE(waitq, proc_p, proc_list);
+    sim_proc_setstate(proc_p, READY);
+    TAILQ_INSERT_TAIL(&ready_queue, proc_p, proc_list);
+    sprintf(log_msg, "[Trace] State change LOCKWAIT->READY (%s %s)", what, name);
+    sim_logging(proc_p, log_msg);
+    sim_enqueue(proc_p);
+}
+
+void sim_mutex_grant(struct sim_mutex *m, struct sim_proc *proc_p) {
+    m->owner = proc_p;
+    m->lock_time = sim_engine_getclock();
+    m->acquisitions++;
+    TAILQ_INSERT_TAIL(&mutex_held[proc_p - procs], m, held_list);
+    sim_proc_update_priority(proc_p);
+}
+
+void sim_mutex_lock(struct sim_mutex *m) {
+    struct sim_proc *proc_p = activeproc;
+
+    if (m->owner == NULL) {
+        sim_mutex_grant(m, proc_p);
+        return;
+    }
+    if (m->owner == proc_p) {
+        sim_logging(proc_p, "[Error] Recursive mutex lock");
+        return;
+    }
+
+    m->contended++;
+    if (++m->nwaiters > m->convoy_max)
+        m->convoy_max = m->nwaiters;
+    proc_p->wait_mutex = m;
+    proc_p->inversion_since = -1;
+    proc_p->inversion_time = 0;
+
+    sim_sync_block(&m->waiters, "mutex", m->name);
+    /* 被唤醒时 sim_mutex_unlock 已经把 mutex 交给了本进程 */
+}
+
+void sim_mutex_unlock(struct sim_mutex *m) {
+    struct sim_proc *proc_p = activeproc, *w, *next = NULL;
+    long long clock = sim_engine_getclock();
+    long long hold = clock - m->lock_time;
+
+    if (m->owner != proc_p) {
+        sim_logging(proc_p, "[Error] Unlock of a mutex not owned by the process");
+        return;
+    }
+
+    m->hold_total += hold;
+    if (hold > m->hold_max)
+        m->hold_max = hold;
+    TAILQ_REMOVE(&mutex_held[proc_p - procs], m, held_list);
+    m->owner = NULL;
+    sim_mutex_inversion(m);
+
+    /* 交给优先级最高的等待者 (同优先级 FIFO) */
+    TAILQ_FOREACH(w, &m->waiters, proc_list) {
+        if (next == NULL || w->priority < next->priority)
+            next = w;
+    }
+    if (next != NULL) {
+        m->nwaiters--;
+        next->wait_mutex = NULL;
+        if (next->inversion_time > 0) {
+            m->inversion_count++;
+            m->inversion_total += next->inversion_time;
+            if (next->inversion_time > m->inversion_max)
+                m->inversion_max = next->inversion_time;
+        }
+        /* 先交出 mutex 再唤醒: 被唤醒的进程可能在本进程继续之前就开始运行 */
+        TAILQ_REMOVE(&m->waiters, next, proc_list);
+        sim_mutex_grant(m, next);
+        sim_sync_wakeup(NULL, next, "mutex", m->name);
+    }
+    sim_proc_update_priority(proc_p);
+}
+
+void sim_sem_wait(struct sim_sem *sem) {
+    if (sem->count > 0) {
+        sem->count--;
+        return;
+    }
+    sem->waits++;
+    if (++sem->nwaiters > sem->convoy_max)
+        sem->convoy_max = sem->nwaiters;
+    sim_sync_block(&sem->waiters, "semaphore", sem->name);
+    /* sim_sem_post 直接把计数交给了本进程 */
+}
+
+void sim_sem_post(struct sim_sem *sem) {
+    struct sim_proc *w = TAILQ_FIRST(&sem->waiters);
+
+    if (w == NULL) {
+        sem->count++;
+        return;
+    }
+    long long waited = sim_engine_getclock() - w->wait_since;
+    sem->wait_total += waited;
+    if (waited > sem->wait_max)
+        sem->wait_max = waited;
+    sem->nwaiters--;
+    sim_sync_wakeup(&sem->waiters, w, "semaphore", sem->name);
+}
+
+void sim_cond_wait(struct sim_cond *c, struct sim_mutex *m) {
+    c->waits++;
+    c->nwaiters++;
+    sim_mutex_unlock(m);
+    sim_sync_block(&c->waiters, "condvar", c->name);
+    sim_mutex_lock(m);
+}
+
+void sim_cond_signal(struct sim_cond *c) {
+    struct sim_proc *w = TAILQ_FIRST(&c->waiters);
+
+    c->signals++;
+    if (w == NULL)
+        return;
+    c->nwaiters--;
+    sim_sync_wakeup(&c->waiters, w, "condvar", c->name);
+}
+
+void sim_cond_broadcast(struct sim_cond *c) {
+    while (!TAILQ_EMPTY(&c->waiters))
+        sim_cond_signal(c);
+}
+
+void sim_sync_report(void) {
+    struct sim_mutex *m;
+    struct sim_sem *sem;
+    struct sim_cond *c;
+    char log_msg[256];
+
+    TAILQ_FOREACH(m, &mutex_all, all_list) {
+        sprintf(log_msg, "[Stats] mutex %s: %d acquisitions, %d contended, hold avg %lld max %lld, convoy max %d, priority inversion %d times total %lld max %lld",
+            m->name, m->acquisitions, m->contended,
+            m->acquisitions > 0 ? m->hold_total / m->acquisitions : 0LL, m->hold_max,
+            m->convoy_max, m->inversion_count, m->inversion_total, m->inversion_max);
+        sim_logging(NULL, log_msg);
+    }
+    TAILQ_FOREACH(sem, &sem_all, all_list) {
+        sprintf(log_msg, "[Stats] semaphore %s: %d waits, wait avg %lld max %lld, convoy max %d",
+            sem->name, sem->waits, sem->waits > 0 ? sem->wait_total / sem->waits : 0LL, sem->wait_max, sem->convoy_max);
+        sim_logging(NULL, log_msg);
+    }
+    TAILQ_FOREACH(c, &cond_all, all_list) {
+        sprintf(log_msg, "[Stats] condvar %s: %d waits, %d signals", c->name, c->waits, c->signals);
+        sim_logging(NULL, log_msg);
+    }
 }
 
 void sim_logging(struct sim_proc *proc_p, const char *msg) {
-    int clock = sim_engine_getclock();
+    long long clock = sim_engine_getclock();
+    bool cost_timing = sim_cost_stop(); // 输出日志不算调度开销
+    SIM_PROF_BEGIN();
     if (proc_p != NULL && proc_p->proc_state != NOEXIST) {
-        printf("%d.%03d Process#%d(Prio%d) %s\n", clock / 1000, clock % 1000, proc_p->proc_pid, proc_p->priority, msg);
+        printf("%lld.%03lld %s(Prio%d) %s\n", clock / 1000, clock % 1000, sim_proc_name(proc_p), proc_p->priority, msg);
     } else if (proc_p == NULL && msg != NULL) { 
-        printf("%d.%03d Scheduler %s\n", clock / 1000, clock % 1000, msg);
+        printf("%lld.%03lld Scheduler %s\n", clock / 1000, clock % 1000, msg);
     } else if (proc_p != NULL && proc_p->proc_state == NOEXIST && msg != NULL) { // 处理已标记为NOEXIST但仍想记录PID的情况
-        printf("%d.%03d Process#%d(Prio%d) %s\n", clock / 1000, clock % 1000, proc_p->proc_pid, proc_p->priority, msg);
+        printf("%lld.%03lld %s(Prio%d) %s\n", clock / 1000, clock % 1000, sim_proc_name(proc_p), proc_p->priority, msg);
     }
      else { 
-         printf("%d.%03d System %s\n", clock / 1000, clock % 1000, (msg ? msg : "Unknown event"));
+         printf("%lld.%03lld System %s\n", clock / 1000, clock % 1000, (msg ? msg : "Unknown event"));
     }
+    sim_cost_start(cost_timing);
+    SIM_PROF_END();
 }
 
 /* --- 新增的更实际的进程行为函数 --- */
@@ -222,7 +1257,7 @@ void sim_proc_data_processing(void) {
     for (i = 0; i < 2; i++) {
         sim_logging(activeproc, "[App] Data Processing: Storing intermediate results (I/O 50 units)");
         sim_iorequest(50);
-        int random_cpu_burst = (rand() % 100) + 50; 
+        int random_cpu_burst = sim_rand_range(&activeproc->proc_rand, 50, 149);
         char burst_msg[60];
         sprintf(burst_msg, "[App] Data Processing: Quick processing (%d CPU units)", random_cpu_burst);
         sim_logging(activeproc, burst_msg);
@@ -244,8 +1279,8 @@ void sim_proc_interactive(void) {
     int i;
     sim_logging(activeproc, "[App] Interactive Process: Started");
     for (i = 0; i < 5; i++) { // 假设有5轮交互
-        int user_think_time = (rand() % 200) + 50; 
-        int short_cpu_burst = (rand() % 20) + 5;   
+        int user_think_time = sim_rand_range(&activeproc->proc_rand, 50, 249);
+        int short_cpu_burst = sim_rand_range(&activeproc->proc_rand, 5, 24);
         char log_msg_io[80], log_msg_cpu[80];
 
         sprintf(log_msg_io, "[App] Interactive: Waiting for user input (%d I/O units)", user_think_time);
@@ -285,15 +1320,154 @@ void sim_proc_iobound(void) {
 }
 
 
-int main(int argc, char **argv) {
+/* --- 内存访问 --- */
+
+/* 访问本进程的一个虚拟页面；缺页时通过 I/O 请求阻塞，直到页面调入 */
+int sim_memaccess(int page, bool write) {
+    long long cost = sim_vm_access(&activeproc->proc_vm, page, write, sim_engine_getclock());
+
+    if (cost > 0) {
+        char log_msg[80];
+        sprintf(log_msg, "[Trace] Page fault on page %d (%lld I/O units)", page, cost);
+        sim_logging(activeproc, log_msg);
+        sim_iorequest(cost);
+    }
+    return cost > 0;
+}
+
+/* 所有 CPU 的平均利用率 (%) */
+double sim_cpu_utilization(void) {
+    long long clock = sim_engine_getclock();
+    long long busy = 0;
+    int c;
+
+    for (c = 0; c < nr_cpus; c++)
+        busy += sim_engine_cpu_busytime(c);
+    return clock > 0 ? 100.0 * busy / ((double)clock * nr_cpus) : 0.0;
+}
+
+void sim_vm_report(void) {
+    int faults, writebacks, evictions;
+    char log_msg[200];
+
+    sim_vm_stats(&faults, &writebacks, &evictions);
+    sprintf(log_msg, "[Stats] vm: %s, %d frames, %d faults, %d evictions, %d writebacks, CPU utilization %.1f%%",
+        sim_vm_policy_name(vm_policy), vm_frames, faults, evictions, writebacks, sim_cpu_utilization());
+    sim_logging(NULL, log_msg);
+}
+
+/* 分阶段改变局部性的内存密集型进程 (-w paging) */
+#define MEM_WSS 12 // 每个阶段的工作集大小 (页)
+
+void sim_proc_memory(void) {
+    int phase, i;
+    char log_msg[80];
+
+    sim_logging(activeproc, "[App] Memory Task: Starting");
+    for (phase = 0; phase < 6; phase++) {
+        int base = sim_rand_range(&activeproc->proc_rand, 0, VM_PROC_PAGES - MEM_WSS);
+
+        sprintf(log_msg, "[App] Memory Task: Phase %d, working set pages %d-%d", phase, base, base + MEM_WSS - 1);
+        sim_logging(activeproc, log_msg);
+        for (i = 0; i < 40; i++) {
+            int page = base + sim_rand_range(&activeproc->proc_rand, 0, MEM_WSS - 1);
+
+            sim_memaccess(page, sim_rand_range(&activeproc->proc_rand, 0, 3) == 0);
+            sim_cpuburst(10);
+        }
+    }
+    sim_logging(activeproc, "[App] Memory Task: Finished");
+}
+
+/* --- 锁竞争 workload (-w locks) --- */
+
+struct sim_mutex shared_lock;    // 低/高优先级进程共享，用于观察优先级反转
+struct sim_mutex buffer_lock;    // 生产者/消费者的缓冲区
+struct sim_cond buffer_nonempty, buffer_nonfull;
+struct sim_sem io_slots;         // 同时只允许一个消费者写出
+int buffer_items = 0;
+#define BUFFER_SIZE 2
+
+void sim_proc_lock_low(void) {
     int i;
+    sim_logging(activeproc, "[App] Lock Holder: Starting");
+    for (i = 0; i < 3; i++) {
+        sim_mutex_lock(&shared_lock);
+        sim_logging(activeproc, "[App] Lock Holder: Holding shared lock (CPU 300 units)");
+        sim_cpuburst(300);
+        sim_mutex_unlock(&shared_lock);
+        sim_logging(activeproc, "[App] Lock Holder: Released shared lock (I/O 30 units)");
+        sim_iorequest(30);
+    }
+    sim_logging(activeproc, "[App] Lock Holder: Finished");
+}
 
-    srand(time(NULL)); // 初始化随机数种子，为 interactive 和 data_processing 进程
+void sim_proc_lock_high(void) {
+    int i;
+    sim_logging(activeproc, "[App] Urgent Task: Starting");
+    for (i = 0; i < 3; i++) {
+        sim_logging(activeproc, "[App] Urgent Task: Waiting for event (I/O 40 units)");
+        sim_iorequest(40);
+        sim_mutex_lock(&shared_lock);
+        sim_logging(activeproc, "[App] Urgent Task: Holding shared lock (CPU 20 units)");
+        sim_cpuburst(20);
+        sim_mutex_unlock(&shared_lock);
+    }
+    sim_logging(activeproc, "[App] Urgent Task: Finished");
+}
 
-    sim_engine_init(sim_intr_devioready, sim_intr_cpurunout, sim_intr_procexit);
-    // memset(procs, 0, sizeof(struct sim_proc) * SIM_MAXPROCS); // proc_state=NOEXIST 已经是0
+void sim_proc_cpu_medium(void) {
+    int i;
+    sim_logging(activeproc, "[App] Medium CPU Task: Starting");
+    for (i = 0; i < 2; i++) {
+        sim_logging(activeproc, "[App] Medium CPU Task: Requesting I/O (50 units)");
+        sim_iorequest(50);
+        sim_logging(activeproc, "[App] Medium CPU Task: Starting CPU burst (600 units)");
+        sim_cpuburst(600);
+    }
+    sim_logging(activeproc, "[App] Medium CPU Task: Finished");
+}
 
-    sim_logging(NULL, "System Initialized. Creating processes...");
+void sim_proc_producer(void) {
+    int i;
+    sim_logging(activeproc, "[App] Producer: Starting");
+    for (i = 0; i < 6; i++) {
+        sim_logging(activeproc, "[App] Producer: Waiting for input (I/O 30 units)");
+        sim_iorequest(30);
+        sim_cpuburst(sim_rand_range(&activeproc->proc_rand, 20, 60));
+        sim_mutex_lock(&buffer_lock);
+        while (buffer_items == BUFFER_SIZE)
+            sim_cond_wait(&buffer_nonfull, &buffer_lock);
+        buffer_items++;
+        sim_logging(activeproc, "[App] Producer: Item produced");
+        sim_cond_signal(&buffer_nonempty);
+        sim_mutex_unlock(&buffer_lock);
+    }
+    sim_logging(activeproc, "[App] Producer: Finished");
+}
+
+void sim_proc_consumer(void) {
+    int i;
+    sim_logging(activeproc, "[App] Consumer: Starting");
+    for (i = 0; i < 3; i++) {
+        sim_mutex_lock(&buffer_lock);
+        while (buffer_items == 0)
+            sim_cond_wait(&buffer_nonempty, &buffer_lock);
+        buffer_items--;
+        sim_logging(activeproc, "[App] Consumer: Item consumed");
+        sim_cond_signal(&buffer_nonfull);
+        sim_mutex_unlock(&buffer_lock);
+
+        sim_sem_wait(&io_slots);
+        sim_logging(activeproc, "[App] Consumer: Writing item (I/O 80 units)");
+        sim_iorequest(80);
+        sim_sem_post(&io_slots);
+    }
+    sim_logging(activeproc, "[App] Consumer: Finished");
+}
+
+void sim_workload_default(void) {
+    int i;
 
     // 创建不同类型的进程和不同优先级
     sim_createproc(sim_proc_interactive, PRIORITY_HIGH);      // 交互式进程，高优先级
@@ -303,13 +1477,313 @@ int main(int argc, char **argv) {
     for (i = 0; i < 2; i++) { // 创建几个I/O密集型进程
         sim_createproc(sim_proc_iobound, PRIORITY_NORMAL); // I/O密集型，普通优先级
     }
+}
+
+/* 大小核 workload (-w mixed): CPU 密集型、交互式和 I/O 密集型进程混合 */
+void sim_workload_mixed(void) {
+    int i;
+
+    for (i = 0; i < 2; i++)
+        sim_createproc(sim_proc_cpubound, PRIORITY_LOW);
+    sim_createproc(sim_proc_data_processing, PRIORITY_NORMAL);
+    for (i = 0; i < 3; i++)
+        sim_createproc(sim_proc_interactive, PRIORITY_HIGH);
+    for (i = 0; i < 2; i++)
+        sim_createproc(sim_proc_iobound, PRIORITY_NORMAL);
+}
+
+/* 多道程序度 = nr_memprocs 个 sim_proc_memory 进程 */
+int nr_memprocs = 4;
+
+void sim_workload_paging(void) {
+    int i;
+
+    for (i = 0; i < nr_memprocs; i++)
+        sim_createproc(sim_proc_memory, PRIORITY_NORMAL);
+}
+
+void sim_workload_locks(void) {
+    sim_mutex_init(&shared_lock, "shared", mutex_protocol, PRIORITY_HIGH);
+    sim_mutex_init(&buffer_lock, "buffer", mutex_protocol, PRIORITY_NORMAL);
+    sim_cond_init(&buffer_nonempty, "nonempty");
+    sim_cond_init(&buffer_nonfull, "nonfull");
+    sim_sem_init(&io_slots, "io_slots", 1);
+
+    sim_createproc(sim_proc_lock_low, PRIORITY_LOW);
+    sim_createproc(sim_proc_lock_high, PRIORITY_HIGH);
+    sim_createproc(sim_proc_cpu_medium, PRIORITY_NORMAL);
+    sim_createproc(sim_proc_producer, PRIORITY_NORMAL);
+    sim_createproc(sim_proc_consumer, PRIORITY_LOW);
+    sim_createproc(sim_proc_consumer, PRIORITY_LOW);
+}
+
+int main(int argc, char **argv) {
+    int opt, i;
+    const char *workload = "default";
+    int nbig = 1, nlittle = 0;
+
+    while ((opt = getopt(argc, argv, "s:t:b:w:p:f:m:n:q:g:c:N:d:L:a:P:C:i:FD:O:T:S:")) != -1) {
+        switch (opt) {
+        case 's': // 随机数种子，相同种子得到相同的输出
+            sim_seed = strtoull(optarg, NULL, 0);
+            break;
+        case 't': // Chrome/Perfetto trace 输出文件
+            if (!sim_trace_open(optarg)) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 'b': // sim_analyze 用的二进制 trace 输出文件
+            if (!sim_trace_open_bin(optarg)) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 'w': // workload: default | locks | paging | mixed | cluster | threads
+            workload = optarg;
+            break;
+        case 'p': // mutex 协议: none | inherit | ceiling
+            if (strcmp(optarg, "inherit") == 0)
+                mutex_protocol = SIM_MUTEX_INHERIT;
+            else if (strcmp(optarg, "ceiling") == 0)
+                mutex_protocol = SIM_MUTEX_CEILING;
+            else
+                mutex_protocol = SIM_MUTEX_NONE;
+            break;
+        case 'f': // 物理页框数，启用分页模型
+            vm_frames = atoi(optarg);
+            break;
+        case 'm': // 页面置换策略
+            if (sim_vm_policy_parse(optarg) < 0) {
+                fprintf(stderr, "%s: unknown replacement policy %s\n", argv[0], optarg);
+                return 1;
+            }
+            vm_policy = sim_vm_policy_parse(optarg);
+            break;
+        case 'n': // paging/threads workload 的进程数 / cluster workload 的作业数
+            nr_memprocs = atoi(optarg);
+            nr_jobs = atoi(optarg);
+            nr_thread_procs = atoi(optarg);
+            break;
+        case 'T': // threads workload 中每个进程的线程数
+            nr_threads = atoi(optarg);
+            if (nr_threads < 1) {
+                fprintf(stderr, "%s: bad number of threads %s\n", argv[0], optarg);
+                return 1;
+            }
+            break;
+        case 'q': // 时间片: fixed | adaptive
+            adaptive_quantum = strcmp(optarg, "adaptive") == 0;
+            break;
+        case 'g': // CPU 调速器: performance | powersave | ondemand | schedutil | eas
+            energy_report = 1;
+            if (strcmp(optarg, "powersave") == 0) {
+                sim_engine_set_governor(SIM_GOV_POWERSAVE);
+            } else if (strcmp(optarg, "ondemand") == 0) {
+                sim_engine_set_governor(SIM_GOV_ONDEMAND);
+            } else if (strcmp(optarg, "schedutil") == 0) {
+                sim_engine_set_governor(SIM_GOV_SCHEDUTIL);
+            } else if (strcmp(optarg, "eas") == 0) {
+                sim_engine_set_governor(SIM_GOV_USERSPACE);
+                energy_aware = 1;
+            } else {
+                sim_engine_set_governor(SIM_GOV_PERFORMANCE);
+            }
+            break;
+        case 'c': // CPU 配置 (每个节点): 大核数[:小核数]
+            nlittle = 0;
+            if (sscanf(optarg, "%d:%d", &nbig, &nlittle) < 1 || nbig < 0 || nlittle < 0 ||
+                nbig + nlittle < 1 || nbig + nlittle > SIM_ENGINE_MAXCPUS) {
+                fprintf(stderr, "%s: bad CPU configuration %s\n", argv[0], optarg);
+                return 1;
+            }
+            cpu_report = 1;
+            break;
+        case 'N': // 集群节点数
+            nr_nodes = atoi(optarg);
+            if (nr_nodes < 1 || nr_nodes > SIM_MAXNODES) {
+                fprintf(stderr, "%s: bad number of nodes %s\n", argv[0], optarg);
+                return 1;
+            }
+            break;
+        case 'd': // 前端分派策略: random | rr | least | p2c | jiq
+            for (i = 0; i <= DISPATCH_JIQ; i++) {
+                if (strcmp(optarg, dispatch_policy_names[i]) == 0)
+                    break;
+            }
+            if (i > DISPATCH_JIQ) {
+                fprintf(stderr, "%s: unknown dispatch policy %s\n", argv[0], optarg);
+                return 1;
+            }
+            dispatch_policy = i;
+            break;
+        case 'L': // 网络延迟: N 或 exp:N
+            net_latency_exp = strncmp(optarg, "exp:", 4) == 0;
+            net_latency = atoi(net_latency_exp ? optarg + 4 : optarg);
+            break;
+        case 'a': // cluster workload 的平均到达间隔
+            job_interarrival = atoi(optarg);
+            break;
+        case 'S': // cluster workload 的服务时间表文件
+            if (!sim_service_load(optarg)) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 'P': // 调度策略: prio | rr | fcfs | gang | cosched
+            for (i = 0; i <= SCHED_COSCHED; i++) {
+                if (strcmp(optarg, sched_policy_names[i]) == 0)
+                    break;
+            }
+            if (i > SCHED_COSCHED) {
+                fprintf(stderr, "%s: unknown scheduling policy %s\n", argv[0], optarg);
+                return 1;
+            }
+            sched_policy = i;
+            break;
+        case 'i': { // I/O 中断合并: 窗口[:数量]
+            int window = 0, count = 0;
+
+            if (sscanf(optarg, "%d:%d", &window, &count) < 1 || window < 0 || count < 0) {
+                fprintf(stderr, "%s: bad coalescing setting %s\n", argv[0], optarg);
+                return 1;
+            }
+            sim_engine_set_coalesce(window, count, sim_intr_devioready_batch);
+            irq_report = 1;
+            break;
+        }
+        case 'F': // 快进: 负载稳定时跳过不会改变频率的调速器采样
+            sim_engine_set_fastforward(true);
+            break;
+        case 'D': // 每隔 period 模拟时间输出一次宿主机性能计数，需要用 -DSIM_PROF 编译
+#ifdef SIM_PROF
+            sim_prof_set_period(atoll(optarg));
+#else
+            fprintf(stderr, "%s: -D needs a build with -DSIM_PROF, ignored\n", argv[0]);
+#endif
+            break;
+        case 'O': // 调度开销: 每次队列操作的纳秒数[:每个元素的纳秒数] 或 host[:系数]
+            if (strncmp(optarg, "host", 4) == 0) {
+                cost_model = COST_HOST;
+                if (optarg[4] == ':')
+                    cost_host_scale = atof(optarg + 5);
+                if ((optarg[4] != ':' && optarg[4] != '\0') || cost_host_scale <= 0) {
+                    fprintf(stderr, "%s: bad cost model %s\n", argv[0], optarg);
+                    return 1;
+                }
+            } else {
+                cost_model = COST_COUNT;
+                if (sscanf(optarg, "%lld:%lld", &cost_op_ns, &cost_elem_ns) < 1 || cost_op_ns < 0 || cost_elem_ns < 0) {
+                    fprintf(stderr, "%s: bad cost model %s\n", argv[0], optarg);
+                    return 1;
+                }
+            }
+            break;
+        case 'C': // 对比模式: 逗号分隔的调度策略列表
+            if (!sim_compare_parse(optarg)) {
+                fprintf(stderr, "%s: bad policy list %s\n", argv[0], optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s seed] [-t trace.json] [-b trace.bin] [-w default|locks|paging|mixed|cluster|threads] [-p none|inherit|ceiling]\n"
+                "       [-f frames] [-m fifo|clock|lru|wsclock] [-n procs|jobs] [-T threads] [-q fixed|adaptive]\n"
+                "       [-g performance|powersave|ondemand|schedutil|eas] [-c big[:little]]\n"
+                "       [-N nodes] [-d random|rr|least|p2c|jiq] [-L latency|exp:mean] [-a interarrival] [-S service_table]\n"
+                "       [-P prio|rr|fcfs|gang|cosched] [-C policy,policy,...] [-i window[:count]] [-F] [-D period]\n"
+                "       [-O op_ns[:elem_ns]|host[:scale]]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (strcmp(workload, "cluster") == 0 && nr_nodes == 1)
+        nr_nodes = 4;
+    if (strcmp(workload, "threads") == 0 && !cpu_report) { // 线程要能同时运行，默认 4 个 CPU
+        nbig = 4;
+        cpu_report = 1;
+    }
+    if (cpu_report || nr_nodes > 1) {
+        struct sim_engine_cputype types[SIM_ENGINE_MAXCPUS];
+
+        cpus_per_node = nbig + nlittle;
+        if (nr_nodes * cpus_per_node > SIM_ENGINE_MAXCPUS) {
+            fprintf(stderr, "%s: %d nodes x %d CPUs exceeds %d CPUs\n", argv[0], nr_nodes, cpus_per_node, SIM_ENGINE_MAXCPUS);
+            return 1;
+        }
+        for (i = 0; i < nr_nodes * cpus_per_node; i++)
+            types[i] = i % cpus_per_node < nbig ? sim_engine_cpu_big : sim_engine_cpu_little;
+        nr_cpus = nr_nodes * cpus_per_node;
+        sim_engine_setcpus(nr_cpus, types);
+    }
+
+    if (strcmp(workload, "threads") == 0 && nr_threads > cpus_per_node) {
+        if (sched_policy == SCHED_GANG || sim_compare_has(SCHED_GANG)) {
+            fprintf(stderr, "%s: gang scheduling needs at least %d CPUs per node for %d threads\n", argv[0], nr_threads, nr_threads);
+            return 1;
+        }
+    }
+
+    if (nr_compare > 0) {
+        if (sim_trace_enabled) {
+            fprintf(stderr, "%s: -C cannot be combined with -t/-b\n", argv[0]);
+            return 1;
+        }
+        i = sim_compare_run(argv[0], workload);
+        if (i >= 0)
+            return i;
+    }
+
+    sim_engine_init(sim_intr_devioready, sim_intr_cpurunout, sim_intr_procexit);
+    // memset(procs, 0, sizeof(struct sim_proc) * SIM_MAXPROCS); // proc_state=NOEXIST 已经是0
+
+    sim_logging(NULL, "System Initialized. Creating processes...");
+
+    if (strcmp(workload, "paging") == 0 && vm_frames == 0)
+        vm_frames = 32;
+    if (vm_frames > 0)
+        sim_vm_init(vm_frames, vm_policy, SIM_VM_WSCLOCK_TAU);
+
+    if (strcmp(workload, "locks") == 0) {
+        sim_workload_locks();
+    } else if (strcmp(workload, "paging") == 0) {
+        sim_workload_paging();
+    } else if (strcmp(workload, "mixed") == 0) {
+        sim_workload_mixed();
+    } else if (strcmp(workload, "cluster") == 0) {
+        sim_workload_cluster();
+    } else if (strcmp(workload, "threads") == 0) {
+        sim_workload_threads();
+    } else {
+        sim_workload_default();
+    }
 
     sim_logging(NULL, "All processes created. Starting scheduler.");
-    sched(); 
+    for (i = 0; i < nr_cpus; i++) {
+        if (cpu_curr[i] == NULL) // gang/cosched 可能已经把线程分派到后面的 CPU 上
+            sched_cpu(i);
+    }
 
     sim_engine_wait_allfinish(); 
 
     sim_logging(NULL, "All processes terminated. Simulation finished.");
+    sim_sync_report();
+    if (vm_frames > 0)
+        sim_vm_report();
+    if (cpu_report)
+        sim_cpu_report();
+    if (strcmp(workload, "cluster") == 0)
+        sim_cluster_report();
+    if (energy_report)
+        sim_energy_report();
+    if (irq_report)
+        sim_irq_report();
+    if (cost_model != COST_NONE)
+        sim_cost_report();
+    if (strcmp(workload, "threads") == 0 || sched_policy == SCHED_GANG || sched_policy == SCHED_COSCHED)
+        sim_gang_report();
+    if (compare_out != NULL)
+        sim_compare_finish();
+    sim_trace_close();
 
     return 0;
-}
\ No newline at end of file
+}
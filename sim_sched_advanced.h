@@ -0,0 +1,196 @@
+// 文件名: sim_sched_advanced.h
+/*
+ * 调度器各个源文件共用的定义: 进程表、运行队列、同步对象，以及调度器核心
+ * (sim_sched_advanced.c) 提供给其他部分的变量和函数。
+ */
+#ifndef SIM_SCHED_ADVANCED_H
+#define SIM_SCHED_ADVANCED_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/queue.h>
+
+#include "sim_engine.h"
+#include "sim_rand.h"
+#include "sim_vm.h"
+
+#ifndef SIM_MAXPROCS
+#define SIM_MAXPROCS 256 // 进程表大小；上万个进程的实验 (如 -O) 用 -DSIM_MAXPROCS=16384 编译
+#endif
+#define SIM_CPUMAXBURST 100 // Time slice for preemption
+#define SIM_IRQ_COST_US 5 // 每次 I/O 中断的处理开销 (微秒)，只用于 -i 的统计
+
+// 自适应时间片 (-q adaptive) 的参数
+#define SCHED_TARGET_LATENCY 300 // 每个就绪进程在这段时间内至少运行一次
+#define SCHED_MIN_GRANULARITY 20 // 时间片下限，限制切换开销
+#define SCHED_MAX_SLICE 1000     // 没有竞争者时的时间片
+
+// 大小核 (-c) 的任务放置: 利用率按最大 CPU 容量归一化到 SCHED_CAPACITY_SCALE
+#define SCHED_CAPACITY_SCALE 1024
+#define PELT_HALFLIFE 32 // PELT 衰减: 利用率的贡献每 32 个时间单位减半
+
+// 定义进程优先级 (数值越小，优先级越高)
+#define PRIORITY_HIGH 1
+#define PRIORITY_NORMAL 2
+#define PRIORITY_LOW 3
+
+enum sim_proc_state {
+    NOEXIST = 0,
+    READY,
+    RUNNING,
+    BLOCKED,
+    LOCKWAIT // 在 mutex/semaphore/condvar/屏障上等待
+};
+
+struct sim_mutex;
+struct sim_thread_group;
+
+struct sim_proc {
+    int proc_pid;
+    enum sim_proc_state proc_state;
+    struct sim_cpustate proc_cpustate;
+    int priority; // 新增：进程优先级 (有效优先级，可能被优先级继承/天花板提升)
+    int base_priority; // 创建时指定的优先级
+    long long creation_time; // 新增：进程创建时间，用于计算周转时间
+    struct sim_rand proc_rand; // 进程私有的随机数流 (seed, pid)
+    struct sim_mutex *wait_mutex; // 正在等待的 mutex
+    long long wait_since; // 开始等待同步对象的时刻
+    long long inversion_since; // 正处于优先级反转时为开始的时刻，否则为 -1
+    long long inversion_time; // 本次等待 mutex 期间累计的优先级反转时间
+    struct sim_vm_space proc_vm; // 虚拟地址空间 (仅在 -f 启用分页时使用)
+    long long dispatch_time; // 最近一次进入 RUNNING 的时刻
+    long long cur_burst; // 当前 CPU burst 已运行的时间 (跨越抢占累计)
+    long long avg_burst; // 最近 CPU burst 长度的指数平均 (阻塞或退出时更新)
+    long long slice_end; // 本次时间片结束的时刻
+    int proc_cpu; // 运行所在的 CPU；就绪时为所在运行队列的 CPU
+    int util_avg; // PELT 风格的利用率 (0..SCHED_CAPACITY_SCALE)
+    long long util_update; // util_avg 最近一次更新的时刻
+    long long ready_since; // 最近一次进入 READY 的时刻
+    int proc_node; // 所在节点 (-N)；作业在前端分派之前为 -1
+    long long arrival_time; // 作业到达前端的时刻 (非作业进程为 -1)
+    bool in_flight; // 作业已分派、还在网络上传输
+    long long state_since; // 进入当前状态的时刻
+    long long state_time[LOCKWAIT + 1]; // 在各状态中累计的时间
+    long long first_run; // 第一次进入 RUNNING 的时刻 (还没运行过时为 -1)
+    int nr_dispatch; // 进入 RUNNING 的次数
+    struct sim_thread_group *group; // 多线程进程的线程组 (单线程进程为 NULL)
+    int proc_tid; // 在线程组中的编号
+
+    TAILQ_ENTRY(sim_proc) proc_list;
+};
+extern struct sim_proc procs[SIM_MAXPROCS];
+
+/*
+ * 调度策略 (-P): 按优先级、忽略优先级的时间片轮转、不可抢占的先来先服务；
+ * gang 和 cosched 与 rr 相同，另外让多线程进程的线程同时运行 (见 sim_gang_pick)
+ */
+enum sim_sched_policy {
+    SCHED_PRIO = 0,
+    SCHED_RR,
+    SCHED_FCFS,
+    SCHED_GANG,
+    SCHED_COSCHED
+};
+
+extern const char *sched_policy_names[];
+extern enum sim_sched_policy sched_policy;
+extern unsigned long long sim_seed;
+
+/* 每个 CPU 上正在运行的进程 */
+extern struct sim_proc *cpu_curr[SIM_ENGINE_MAXCPUS];
+extern int nr_cpus;
+/* 集群 (-N): 节点 n 拥有 CPU [n * cpus_per_node, (n + 1) * cpus_per_node)，各自调度 */
+#define SIM_MAXNODES SIM_ENGINE_MAXCPUS
+extern int nr_nodes;
+extern int cpus_per_node;
+extern int node_load[SIM_MAXNODES];
+extern long long node_load_area[SIM_MAXNODES];
+extern long long node_spread_area;
+extern int node_inflight[SIM_MAXNODES];
+/* Active Process: 当前 CPU 上的进程 (在进程上下文中就是调用者自己) */
+#define activeproc (cpu_curr[sim_engine_getcpu()])
+TAILQ_HEAD(ready_queue, sim_proc);
+TAILQ_HEAD(blocked_queue, sim_proc);
+extern struct ready_queue ready_queue;
+extern struct blocked_queue blocked_queue;
+extern int nr_ready;
+extern int nr_migrations;
+/* 按优先级统计 READY->RUNNING 的等待时间 (响应时间) */
+extern long long resp_total[PRIORITY_LOW + 1];
+extern int resp_count[PRIORITY_LOW + 1];
+
+/*
+ * 等待同步对象的进程处于 LOCKWAIT 状态，挂在对象自己的等待队列上
+ * (复用 proc_list，此时它不在 ready_queue 或 blocked_queue 中)。
+ * 唤醒时回到就绪队列尾部，与 I/O 完成的处理相同。
+ */
+TAILQ_HEAD(sim_waitq, sim_proc);
+
+enum sim_mutex_protocol {
+    SIM_MUTEX_NONE = 0,
+    SIM_MUTEX_INHERIT, // 优先级继承
+    SIM_MUTEX_CEILING  // 优先级天花板 (立即提升到 ceiling)
+};
+
+struct sim_mutex {
+    const char *name;
+    enum sim_mutex_protocol protocol;
+    int ceiling;
+    struct sim_proc *owner;
+    long long lock_time;
+    struct sim_waitq waiters;
+    int nwaiters;
+
+    /* statistics */
+    int acquisitions;
+    int contended;
+    long long hold_total, hold_max;
+    int convoy_max; // 等待队列的最大长度
+    int inversion_count; // 经历过优先级反转的等待次数
+    long long inversion_total, inversion_max;
+
+    TAILQ_ENTRY(sim_mutex) held_list; // owner 持有的 mutex 列表
+    TAILQ_ENTRY(sim_mutex) all_list;
+};
+
+struct sim_sem {
+    const char *name;
+    int count;
+    struct sim_waitq waiters;
+    int nwaiters;
+
+    /* statistics */
+    int waits, convoy_max;
+    long long wait_total, wait_max;
+
+    TAILQ_ENTRY(sim_sem) all_list;
+};
+
+struct sim_cond {
+    const char *name;
+    struct sim_waitq waiters;
+    int nwaiters;
+
+    /* statistics */
+    int waits, signals;
+
+    TAILQ_ENTRY(sim_cond) all_list;
+};
+
+/* 调度器核心 (sim_sched_advanced.c) */
+void sim_logging(struct sim_proc *proc_p, const char *msg);
+void sim_proc_setstate(struct sim_proc *proc_p, enum sim_proc_state state);
+void sim_node_account(int node, int delta);
+void sim_cost_count(int ops, int examined);
+int sim_select_cpu(struct sim_proc *proc_p);
+void sim_dispatch_other(struct sim_proc *next, int cpu);
+struct sim_proc *sim_allocproc(void (*func)(void), int priority, struct sim_thread_group *group);
+int sim_createproc(void (*func)(void), int priority);
+int sim_iorequest(long long iowait);
+void sim_sync_block(struct sim_waitq *waitq, const char *what, const char *name);
+void sim_sync_wakeup(struct sim_waitq *waitq, struct sim_proc *proc_p, const char *what, const char *name);
+void sim_proc_cpubound(void);
+void sim_proc_iobound(void);
+double sim_cpu_utilization(void);
+
+#endif
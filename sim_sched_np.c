@@ -111,7 +111,7 @@ void sim_intr_devioready(void *_proc_p)
 
     if (proc_p == NULL || proc_p->proc_state == NOEXIST) {
          // It's possible proc_p points to a cleared structure if exit happened almost concurrently
-        printf("%d.%03d [Trace] I/O ready for an already exited/invalid process?\n", sim_engine_getclock()/1000, sim_engine_getclock()%1000);
+        printf("%lld.%03lld [Trace] I/O ready for an already exited/invalid process?\n", sim_engine_getclock()/1000, sim_engine_getclock()%1000);
         return;
     }
     
@@ -188,13 +188,13 @@ void sim_intr_procexit(void *_proc_p)
 // Modified sim_logging to handle NULL proc_p for system messages
 void sim_logging(struct sim_proc *proc_p, char *msg)
 {
-    int clock = sim_engine_getclock();
+    long long clock = sim_engine_getclock();
     if (proc_p != NULL && proc_p->proc_state != NOEXIST) { // Check if proc_p is valid
-        printf("%d.%03d Process#%d %s\n", clock / 1000, clock % 1000, proc_p->proc_pid, msg);
+        printf("%lld.%03lld Process#%d %s\n", clock / 1000, clock % 1000, proc_p->proc_pid, msg);
     } else if (proc_p == NULL && msg != NULL) { // For general scheduler messages not tied to a specific proc
-        printf("%d.%03d Scheduler %s\n", clock / 1000, clock % 1000, msg);
+        printf("%lld.%03lld Scheduler %s\n", clock / 1000, clock % 1000, msg);
     } else { // Fallback for other odd cases
-         printf("%d.%03d System %s\n", clock / 1000, clock % 1000, (msg ? msg : "Unknown event"));
+         printf("%lld.%03lld System %s\n", clock / 1000, clock % 1000, (msg ? msg : "Unknown event"));
     }
 }
 
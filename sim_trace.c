@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim_engine.h"
+#include "sim_trace.h"
+
+/*
+ * Streaming Chrome Trace Event (JSON) exporter, loadable in Perfetto UI,
+ * and a compact columnar binary trace for sim_analyze.
+ * Every event is written as soon as it happens (the binary sink holds at
+ * most one block), so memory use does not grow with the trace length.
+ *
+ * Track layout:
+ *   pid 1 "CPUs"        one thread per CPU, a slice per RUNNING span
+ *   pid 2 "Processes"   one thread per process, READY/RUNNING/BLOCKED spans
+ *   pid 3 "I/O devices" async slices per outstanding request
+ *   counters            e.g. ready queue length
+ */
+
+#define SIM_TRACE_PID_CPU 1
+#define SIM_TRACE_PID_PROC 2
+#define SIM_TRACE_PID_IO 3
+
+/* Simulated clock units are milliseconds, trace timestamps microseconds */
+#define SIM_TRACE_TS(clock) ((long long)(clock) * 1000)
+
+bool sim_trace_enabled = false;
+
+static FILE *sim_trace_json_fp;
+static FILE *sim_trace_bin_fp;
+static bool sim_trace_first;
+static unsigned long long sim_trace_ioid;
+static uint64_t sim_trace_cpus_named;	/* CPU tracks that have a thread_name */
+static char sim_trace_buf[1 << 16];
+
+/* Both the mask above and the cpu column below must cover every CPU */
+_Static_assert(SIM_ENGINE_MAXCPUS <= 64, "sim_trace_cpus_named has one bit per CPU");
+_Static_assert(SIM_ENGINE_MAXCPUS <= UINT8_MAX + 1, "the binary trace stores the CPU in a uint8_t");
+
+/* The binary block being filled, one array per column */
+static struct {
+	uint32_t count;
+	int64_t clock[SIM_TRACE_BIN_BLOCK];
+	int32_t pid[SIM_TRACE_BIN_BLOCK];
+	int32_t arg[SIM_TRACE_BIN_BLOCK];
+	uint8_t type[SIM_TRACE_BIN_BLOCK];
+	uint8_t cpu[SIM_TRACE_BIN_BLOCK];
+	uint8_t from[SIM_TRACE_BIN_BLOCK];
+	uint8_t to[SIM_TRACE_BIN_BLOCK];
+} sim_trace_blk;
+
+static const char *sim_trace_pstate_name[] = {
+	[SIM_TRACE_NOEXIST] = "NOEXIST",
+	[SIM_TRACE_READY] = "READY",
+	[SIM_TRACE_RUNNING] = "RUNNING",
+	[SIM_TRACE_BLOCKED] = "BLOCKED",
+	[SIM_TRACE_LOCKWAIT] = "LOCKWAIT",
+};
+
+static void _sim_trace_sep(void)
+{
+	if (!sim_trace_first)
+		fputs(",\n", sim_trace_json_fp);
+	sim_trace_first = false;
+}
+
+/* "Process#pid", or "Process#pid.tid" for the track of a later thread */
+static const char *_sim_trace_procname(int pid)
+{
+	static char name[32];
+
+	if (pid >> SIM_TRACE_TID_SHIFT)
+		snprintf(name, sizeof(name), "Process#%d.%d", pid & ((1 << SIM_TRACE_TID_SHIFT) - 1), pid >> SIM_TRACE_TID_SHIFT);
+	else
+		snprintf(name, sizeof(name), "Process#%d", pid);
+	return name;
+}
+
+static void _sim_trace_meta(int pid, int tid, const char *what, const char *name)
+{
+	_sim_trace_sep();
+	fprintf(sim_trace_json_fp, "{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"args\":{\"name\":\"%s\"}}", pid, tid, what, name);
+}
+
+static void _sim_trace_bin_flush(void)
+{
+	uint64_t n = sim_trace_blk.count;
+
+	if (n == 0)
+		return;
+	fwrite(&n, sizeof(n), 1, sim_trace_bin_fp);
+	fwrite(sim_trace_blk.clock, sizeof(sim_trace_blk.clock[0]), n, sim_trace_bin_fp);
+	fwrite(sim_trace_blk.pid, sizeof(sim_trace_blk.pid[0]), n, sim_trace_bin_fp);
+	fwrite(sim_trace_blk.arg, sizeof(sim_trace_blk.arg[0]), n, sim_trace_bin_fp);
+	fwrite(sim_trace_blk.type, 1, n, sim_trace_bin_fp);
+	fwrite(sim_trace_blk.cpu, 1, n, sim_trace_bin_fp);
+	fwrite(sim_trace_blk.from, 1, n, sim_trace_bin_fp);
+	fwrite(sim_trace_blk.to, 1, n, sim_trace_bin_fp);
+	sim_trace_blk.count = 0;
+}
+
+static void _sim_trace_bin_rec(enum sim_trace_rectype type, long long clock, int pid, int cpu, int from, int to, int arg)
+{
+	uint32_t i = sim_trace_blk.count++;
+
+	sim_trace_blk.clock[i] = clock;
+	sim_trace_blk.pid[i] = pid;
+	sim_trace_blk.arg[i] = arg;
+	sim_trace_blk.type[i] = type;
+	sim_trace_blk.cpu[i] = cpu;
+	sim_trace_blk.from[i] = from;
+	sim_trace_blk.to[i] = to;
+	if (sim_trace_blk.count == SIM_TRACE_BIN_BLOCK)
+		_sim_trace_bin_flush();
+}
+
+int sim_trace_open_bin(const char *path)
+{
+	sim_trace_bin_fp = fopen(path, "wb");
+	if (sim_trace_bin_fp == NULL)
+		return 0;
+	fwrite(SIM_TRACE_BIN_MAGIC, 1, 8, sim_trace_bin_fp);
+	sim_trace_blk.count = 0;
+	sim_trace_enabled = true;
+
+	return 1;
+}
+
+int sim_trace_open(const char *path)
+{
+	sim_trace_json_fp = fopen(path, "w");
+	if (sim_trace_json_fp == NULL)
+		return 0;
+	setvbuf(sim_trace_json_fp, sim_trace_buf, _IOFBF, sizeof(sim_trace_buf));
+
+	fputs("[\n", sim_trace_json_fp);
+	sim_trace_first = true;
+	sim_trace_enabled = true;
+
+	_sim_trace_meta(SIM_TRACE_PID_CPU, 0, "process_name", "CPUs");
+	_sim_trace_meta(SIM_TRACE_PID_PROC, 0, "process_name", "Processes");
+	_sim_trace_meta(SIM_TRACE_PID_IO, 0, "process_name", "I/O devices");
+	_sim_trace_meta(SIM_TRACE_PID_CPU, 0, "thread_name", "CPU#0");
+	sim_trace_cpus_named = 1;
+	_sim_trace_meta(SIM_TRACE_PID_IO, 0, "thread_name", "Device#0");
+
+	return 1;
+}
+
+void sim_trace_close(void)
+{
+	if (sim_trace_json_fp != NULL) {
+		fputs("\n]\n", sim_trace_json_fp);
+		fclose(sim_trace_json_fp);
+		sim_trace_json_fp = NULL;
+	}
+	if (sim_trace_bin_fp != NULL) {
+		_sim_trace_bin_flush();
+		fclose(sim_trace_bin_fp);
+		sim_trace_bin_fp = NULL;
+	}
+	sim_trace_enabled = false;
+}
+
+void sim_trace_proc(int pid, const char *name)
+{
+	if (sim_trace_json_fp == NULL)
+		return;
+	_sim_trace_meta(SIM_TRACE_PID_PROC, pid, "thread_name", name);
+}
+
+void sim_trace_state(long long clock, int pid, int cpu, enum sim_trace_pstate from, enum sim_trace_pstate to)
+{
+	if (!sim_trace_enabled || from == to)
+		return;
+	if (sim_trace_bin_fp != NULL)
+		_sim_trace_bin_rec(SIM_TRACE_REC_STATE, clock, pid, cpu, from, to, 0);
+	if (sim_trace_json_fp == NULL)
+		return;
+
+	if (from != SIM_TRACE_NOEXIST) {
+		_sim_trace_sep();
+		fprintf(sim_trace_json_fp, "{\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%lld}", SIM_TRACE_PID_PROC, pid, SIM_TRACE_TS(clock));
+	}
+	if (from == SIM_TRACE_RUNNING) {
+		_sim_trace_sep();
+		fprintf(sim_trace_json_fp, "{\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%lld}", SIM_TRACE_PID_CPU, cpu, SIM_TRACE_TS(clock));
+	}
+	if (to == SIM_TRACE_RUNNING) {
+		if (cpu < 64 && !(sim_trace_cpus_named & (1ULL << cpu))) {
+			char name[16];
+
+			snprintf(name, sizeof(name), "CPU#%d", cpu);
+			_sim_trace_meta(SIM_TRACE_PID_CPU, cpu, "thread_name", name);
+			sim_trace_cpus_named |= 1ULL << cpu;
+		}
+		_sim_trace_sep();
+		fprintf(sim_trace_json_fp, "{\"ph\":\"B\",\"pid\":%d,\"tid\":%d,\"ts\":%lld,\"name\":\"%s\"}", SIM_TRACE_PID_CPU, cpu, SIM_TRACE_TS(clock), _sim_trace_procname(pid));
+	}
+	if (to != SIM_TRACE_NOEXIST) {
+		_sim_trace_sep();
+		fprintf(sim_trace_json_fp, "{\"ph\":\"B\",\"pid\":%d,\"tid\":%d,\"ts\":%lld,\"name\":\"%s\"}", SIM_TRACE_PID_PROC, pid, SIM_TRACE_TS(clock), sim_trace_pstate_name[to]);
+	}
+}
+
+/* The completion time is known at request time, so both ends go out at once */
+void sim_trace_io(long long clock, int pid, int dev, long long duration)
+{
+	if (!sim_trace_enabled)
+		return;
+	if (sim_trace_bin_fp != NULL)
+		_sim_trace_bin_rec(SIM_TRACE_REC_IO, clock, pid, dev, 0, 0, duration > INT32_MAX ? INT32_MAX : duration);
+	if (sim_trace_json_fp == NULL)
+		return;
+
+	sim_trace_ioid++;
+	_sim_trace_sep();
+	fprintf(sim_trace_json_fp, "{\"ph\":\"b\",\"cat\":\"dev%d\",\"id\":%llu,\"pid\":%d,\"tid\":%d,\"ts\":%lld,\"name\":\"I/O %s\"}",
+		dev, sim_trace_ioid, SIM_TRACE_PID_IO, dev, SIM_TRACE_TS(clock), _sim_trace_procname(pid));
+	_sim_trace_sep();
+	fprintf(sim_trace_json_fp, "{\"ph\":\"e\",\"cat\":\"dev%d\",\"id\":%llu,\"pid\":%d,\"tid\":%d,\"ts\":%lld,\"name\":\"I/O %s\"}",
+		dev, sim_trace_ioid, SIM_TRACE_PID_IO, dev, SIM_TRACE_TS(clock + duration), _sim_trace_procname(pid));
+}
+
+void sim_trace_counter(long long clock, const char *name, int value)
+{
+	if (sim_trace_json_fp == NULL)
+		return;
+	_sim_trace_sep();
+	fprintf(sim_trace_json_fp, "{\"ph\":\"C\",\"pid\":%d,\"ts\":%lld,\"name\":\"%s\",\"args\":{\"value\":%d}}", SIM_TRACE_PID_CPU, SIM_TRACE_TS(clock), name, value);
+}
@@ -0,0 +1,49 @@
+#ifndef SIM_TRACE_H
+#define SIM_TRACE_H
+
+#include <stdbool.h>
+
+/* Process states as seen by the trace; schedulers map their own onto these */
+enum sim_trace_pstate {
+	SIM_TRACE_NOEXIST = 0,
+	SIM_TRACE_READY,
+	SIM_TRACE_RUNNING,
+	SIM_TRACE_BLOCKED,
+	SIM_TRACE_LOCKWAIT
+};
+
+/*
+ * Binary trace: the 8-byte magic, then blocks of up to SIM_TRACE_BIN_BLOCK
+ * records stored column by column (host byte order, columns stay 8-byte
+ * aligned since only the last block may be partial):
+ *   uint64_t count;
+ *   int64_t clock[count]; int32_t pid[count]; int32_t arg[count];
+ *   uint8_t type[count]; uint8_t cpu[count]; uint8_t from[count]; uint8_t to[count];
+ * arg is the request length for SIM_TRACE_REC_IO records (saturated at
+ * INT32_MAX).
+ */
+#define SIM_TRACE_BIN_MAGIC "SIMTRC01"
+#define SIM_TRACE_BIN_BLOCK 4096
+
+/*
+ * The pid of a record is really a track: thread tid > 0 of a multi-threaded
+ * process is pid + (tid << SIM_TRACE_TID_SHIFT), thread 0 keeps the pid.
+ */
+#define SIM_TRACE_TID_SHIFT 16
+
+enum sim_trace_rectype {
+	SIM_TRACE_REC_STATE = 1,
+	SIM_TRACE_REC_IO
+};
+
+extern bool sim_trace_enabled;
+
+extern int sim_trace_open(const char *path);
+extern int sim_trace_open_bin(const char *path);
+extern void sim_trace_close(void);
+extern void sim_trace_proc(int pid, const char *name);
+extern void sim_trace_state(long long clock, int pid, int cpu, enum sim_trace_pstate from, enum sim_trace_pstate to);
+extern void sim_trace_io(long long clock, int pid, int dev, long long duration);
+extern void sim_trace_counter(long long clock, const char *name, int value);
+
+#endif
@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim_vm.h"
+
+struct sim_vm_frame {
+	struct sim_vm_space *space;	/* NULL if free */
+	int page;
+	bool referenced;
+	bool dirty;
+	uint8_t age;
+	long long load_time;
+	long long last_use;
+};
+
+static struct sim_vm_frame *sim_vm_frames;
+static int sim_vm_nframes;
+static int sim_vm_nfree;
+static enum sim_vm_policy sim_vm_policy;
+static int sim_vm_tau;
+static int sim_vm_hand;
+static long long sim_vm_last_age;
+/* The paging device serves one transfer at a time; busy until this clock */
+static long long sim_vm_disk_free;
+
+static int sim_vm_total_faults;
+static int sim_vm_total_writebacks;
+static int sim_vm_total_evictions;
+
+static const char *sim_vm_policy_names[] = {
+	[SIM_VM_FIFO] = "fifo",
+	[SIM_VM_CLOCK] = "clock",
+	[SIM_VM_LRU] = "lru",
+	[SIM_VM_WSCLOCK] = "wsclock",
+};
+
+int sim_vm_init(int nframes, enum sim_vm_policy policy, int tau)
+{
+	free(sim_vm_frames);
+	sim_vm_frames = calloc(nframes, sizeof(*sim_vm_frames));
+	if (sim_vm_frames == NULL)
+		return 0;
+	sim_vm_nframes = nframes;
+	sim_vm_nfree = nframes;
+	sim_vm_policy = policy;
+	sim_vm_tau = tau > 0 ? tau : SIM_VM_WSCLOCK_TAU;
+	sim_vm_hand = 0;
+	sim_vm_last_age = 0;
+	sim_vm_disk_free = 0;
+
+	return 1;
+}
+
+const char *sim_vm_policy_name(enum sim_vm_policy policy)
+{
+	return sim_vm_policy_names[policy];
+}
+
+int sim_vm_policy_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(sim_vm_policy_names) / sizeof(sim_vm_policy_names[0])); i++) {
+		if (strcmp(name, sim_vm_policy_names[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+int sim_vm_space_init(struct sim_vm_space *space, int id, int npages)
+{
+	int i;
+
+	memset(space, 0, sizeof(*space));
+	space->frame = malloc(npages * sizeof(*space->frame));
+	if (space->frame == NULL)
+		return 0;
+	for (i = 0; i < npages; i++)
+		space->frame[i] = -1;
+	space->id = id;
+	space->npages = npages;
+
+	return 1;
+}
+
+void sim_vm_space_free(struct sim_vm_space *space)
+{
+	int i;
+
+	if (space->frame == NULL)
+		return;
+	for (i = 0; i < space->npages; i++) {
+		if (space->frame[i] >= 0) {
+			sim_vm_frames[space->frame[i]].space = NULL;
+			sim_vm_nfree++;
+		}
+	}
+	free(space->frame);
+	space->frame = NULL;
+	space->resident = 0;
+}
+
+/* LRU approximation: shift the reference bit into each frame's age */
+static void _sim_vm_age(long long clock)
+{
+	long long n = (clock - sim_vm_last_age) / SIM_VM_AGE_PERIOD;
+	int i;
+
+	/* nine shifts clear every 8-bit age: a long gap costs no more than that */
+	if (n > 9)
+		sim_vm_last_age += (n - 9) * SIM_VM_AGE_PERIOD;
+	while (clock - sim_vm_last_age >= SIM_VM_AGE_PERIOD) {
+		for (i = 0; i < sim_vm_nframes; i++) {
+			struct sim_vm_frame *f = &sim_vm_frames[i];
+
+			f->age = (f->age >> 1) | (f->referenced ? 0x80 : 0);
+			f->referenced = false;
+		}
+		sim_vm_last_age += SIM_VM_AGE_PERIOD;
+	}
+}
+
+static int _sim_vm_victim_fifo(void)
+{
+	int i, victim = 0;
+
+	for (i = 1; i < sim_vm_nframes; i++) {
+		if (sim_vm_frames[i].load_time < sim_vm_frames[victim].load_time)
+			victim = i;
+	}
+	return victim;
+}
+
+static int _sim_vm_victim_clock(void)
+{
+	for (;;) {
+		struct sim_vm_frame *f = &sim_vm_frames[sim_vm_hand];
+		int i = sim_vm_hand;
+
+		sim_vm_hand = (sim_vm_hand + 1) % sim_vm_nframes;
+		if (!f->referenced)
+			return i;
+		f->referenced = false;
+	}
+}
+
+static int _sim_vm_victim_lru(void)
+{
+	int i, victim = 0;
+
+	for (i = 1; i < sim_vm_nframes; i++) {
+		struct sim_vm_frame *f = &sim_vm_frames[i], *v = &sim_vm_frames[victim];
+
+		if (f->age < v->age || (f->age == v->age && f->last_use < v->last_use))
+			victim = i;
+	}
+	return victim;
+}
+
+/*
+ * WSClock: evict the first unreferenced page older than tau, preferring
+ * clean pages; fall back to the oldest page seen if a full sweep finds none.
+ */
+static int _sim_vm_victim_wsclock(long long clock)
+{
+	int n, oldest = -1, dirty_old = -1;
+
+	for (n = 0; n < sim_vm_nframes; n++) {
+		struct sim_vm_frame *f = &sim_vm_frames[sim_vm_hand];
+		int i = sim_vm_hand;
+
+		sim_vm_hand = (sim_vm_hand + 1) % sim_vm_nframes;
+		if (f->referenced) {
+			f->referenced = false;
+			f->last_use = clock;
+			continue;
+		}
+		if (clock - f->last_use > sim_vm_tau) {
+			if (!f->dirty)
+				return i;
+			if (dirty_old < 0)
+				dirty_old = i;
+		}
+		if (oldest < 0 || f->last_use < sim_vm_frames[oldest].last_use)
+			oldest = i;
+	}
+	if (dirty_old >= 0)
+		return dirty_old;
+	return oldest >= 0 ? oldest : sim_vm_hand;
+}
+
+static int _sim_vm_alloc_frame(long long clock, long long *cost)
+{
+	struct sim_vm_frame *f;
+	int i;
+
+	if (sim_vm_nfree > 0) {
+		for (i = 0; i < sim_vm_nframes; i++) {
+			if (sim_vm_frames[i].space == NULL) {
+				sim_vm_nfree--;
+				return i;
+			}
+		}
+	}
+
+	switch (sim_vm_policy) {
+	case SIM_VM_CLOCK:
+		i = _sim_vm_victim_clock();
+		break;
+	case SIM_VM_LRU:
+		i = _sim_vm_victim_lru();
+		break;
+	case SIM_VM_WSCLOCK:
+		i = _sim_vm_victim_wsclock(clock);
+		break;
+	default:
+		i = _sim_vm_victim_fifo();
+		break;
+	}
+
+	f = &sim_vm_frames[i];
+	f->space->frame[f->page] = -1;
+	f->space->resident--;
+	sim_vm_total_evictions++;
+	if (f->dirty) {
+		f->space->writebacks++;
+		sim_vm_total_writebacks++;
+		*cost += SIM_VM_PAGEOUT_TIME;
+	}
+
+	return i;
+}
+
+/*
+ * Touch a page; returns 0 on a hit or the time until the fault is serviced,
+ * including the wait for earlier transfers queued on the paging device.
+ */
+long long sim_vm_access(struct sim_vm_space *space, int page, bool write, long long clock)
+{
+	struct sim_vm_frame *f;
+	long long cost = 0;
+	int i;
+
+	if (sim_vm_nframes == 0 || page < 0 || page >= space->npages)
+		return 0;
+	if (sim_vm_policy == SIM_VM_LRU)
+		_sim_vm_age(clock);
+
+	space->accesses++;
+	i = space->frame[page];
+	if (i < 0) {
+		space->faults++;
+		sim_vm_total_faults++;
+		i = _sim_vm_alloc_frame(clock, &cost);
+		cost += SIM_VM_PAGEIN_TIME;
+		if (sim_vm_disk_free < clock)
+			sim_vm_disk_free = clock;
+		sim_vm_disk_free += cost;
+		cost = sim_vm_disk_free - clock;
+
+		f = &sim_vm_frames[i];
+		f->space = space;
+		f->page = page;
+		f->dirty = false;
+		f->age = 0;
+		f->load_time = clock;
+		space->frame[page] = i;
+		space->resident++;
+	}
+
+	f = &sim_vm_frames[i];
+	f->referenced = true;
+	f->last_use = clock;
+	if (write)
+		f->dirty = true;
+
+	return cost;
+}
+
+void sim_vm_stats(int *faults, int *writebacks, int *evictions)
+{
+	*faults = sim_vm_total_faults;
+	*writebacks = sim_vm_total_writebacks;
+	*evictions = sim_vm_total_evictions;
+}
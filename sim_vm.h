@@ -0,0 +1,46 @@
+#ifndef SIM_VM_H
+#define SIM_VM_H
+
+#include <stdbool.h>
+
+/*
+ * Demand-paging model: a global pool of page frames shared by all address
+ * spaces. sim_vm_access() reports a fault as the time until a single
+ * paging device has serviced it, which the scheduler turns into an
+ * ordinary I/O request.
+ */
+
+enum sim_vm_policy {
+	SIM_VM_FIFO = 0,
+	SIM_VM_CLOCK,
+	SIM_VM_LRU,	/* approximated by 8-bit aging counters */
+	SIM_VM_WSCLOCK
+};
+
+/* Device time to read in a page, and to write back a dirty victim */
+#define SIM_VM_PAGEIN_TIME 20
+#define SIM_VM_PAGEOUT_TIME 20
+/* Aging period of the LRU approximation */
+#define SIM_VM_AGE_PERIOD 50
+/* Default working-set window of WSClock */
+#define SIM_VM_WSCLOCK_TAU 500
+
+struct sim_vm_space {
+	int id;
+	int npages;
+	int *frame;	/* page -> frame, -1 if not resident */
+	int resident;
+	int accesses;
+	int faults;
+	int writebacks;
+};
+
+extern int sim_vm_init(int nframes, enum sim_vm_policy policy, int tau);
+extern int sim_vm_space_init(struct sim_vm_space *space, int id, int npages);
+extern void sim_vm_space_free(struct sim_vm_space *space);
+extern long long sim_vm_access(struct sim_vm_space *space, int page, bool write, long long clock);
+extern const char *sim_vm_policy_name(enum sim_vm_policy policy);
+extern int sim_vm_policy_parse(const char *name);
+extern void sim_vm_stats(int *faults, int *writebacks, int *evictions);
+
+#endif